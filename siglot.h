@@ -2,8 +2,23 @@
 #define __SIGLOT__
 
 #include <set>
+#include <cmath>
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
 #include <type_traits>
 
+// Static tracepoints (see SIGLOT_PROBE below)
+#ifdef SIGLOT_USDT
+#if defined(__has_include)
+#if !__has_include(<sys/sdt.h>)
+#error "SIGLOT_USDT requires sys/sdt.h (systemtap sdt development headers)"
+#endif
+#endif
+#include <sys/sdt.h>
+#endif
+
 //=============================================
 // @filename     siglot.h
 // @author       Sheljohn (Jonathan H)
@@ -22,28 +37,595 @@ struct VoidData {};
 
 
 
+/**
+ * Instrumentation interface.
+ * When SIGLOT_INSTRUMENT is defined, Signals and Slots report their activity
+ * to every installed Probe; otherwise the hooks compile to nothing.
+ *
+ * Signals and Slots are identified by address. Probes must be installed and 
+ * removed while no Signal is being invoked, and must outlive their installation.
+ */
+class Probe
+{
+public:
+
+	Probe(): next(nullptr) {}
+	virtual ~Probe() {}
+
+	virtual void signal_create  ( const void* ) {}
+	virtual void signal_destroy ( const void* ) {}
+	virtual void subscribe      ( const void*, const void* ) {}
+	virtual void unsubscribe    ( const void*, const void* ) {}
+	virtual void emit_begin     ( const void*, unsigned ) {}
+	virtual void emit_end       ( const void* ) {}
+	virtual void slot_begin     ( const void*, const void* ) {}
+	virtual void slot_end       ( const void*, const void* ) {}
+
+	// Signals with deferred delivery: events waiting, and events discarded
+	virtual void queue          ( const void*, uint64_t, uint64_t ) {}
+
+	// Maintain the list of installed probes
+	static void install( Probe *p )
+	{
+		p->next = _head();
+		_head() = p;
+	}
+	static void remove( Probe *p )
+	{
+		for ( Probe **it = &_head(); *it; it = &(*it)->next )
+			if ( *it == p ) { *it = p->next; break; }
+		p->next = nullptr;
+	}
+
+	// Iterate over installed probes
+	inline static Probe* first() { return _head(); }
+	inline Probe* following() const { return next; }
+
+private:
+
+	inline static Probe*& _head() { static Probe *head = nullptr; return head; }
+
+	Probe *next;
+};
+
+/**
+ * Hook points.
+ * With SIGLOT_USDT, each hook is also a static tracepoint "siglot:<hook>" 
+ * (requires sys/sdt.h from systemtap), which perf or bpftrace can attach to
+ * in a running process; it costs a single NOP while nothing is attached.
+ */
+#ifdef SIGLOT_USDT
+#define SIGLOT_USDT_HOOK( hook, ... ) STAP_PROBEV( siglot, hook, __VA_ARGS__ )
+#else
+#define SIGLOT_USDT_HOOK( hook, ... )
+#endif
+
+#ifdef SIGLOT_INSTRUMENT
+#define SIGLOT_PROBE_HOOK( hook, ... ) \
+	for ( siglot::Probe *_probe = siglot::Probe::first(); _probe; _probe = _probe->following() ) \
+		_probe->hook( __VA_ARGS__ )
+#else
+#define SIGLOT_PROBE_HOOK( hook, ... )
+#endif
+
+#define SIGLOT_PROBE( hook, ... ) \
+	do { SIGLOT_USDT_HOOK( hook, __VA_ARGS__ ); SIGLOT_PROBE_HOOK( hook, __VA_ARGS__ ); } while (0)
+
+
+
+/**
+ * Operations to which heap allocations are attributed (see siglot_alloc.h).
+ * An AllocScope marks the operation in progress on the calling thread, until
+ * the end of its scope. Within siglot, SIGLOT_ALLOC_SCOPE marks the storage
+ * changes (alloc_subscribe), the queues (alloc_queue) and the copies of event
+ * data (alloc_copy); it compiles to nothing without SIGLOT_INSTRUMENT.
+ */
+enum AllocOp
+{
+	alloc_other = 0, // outside of any tracked operation
+	alloc_subscribe, // Slot subscription (Signal storage)
+	alloc_invoke,    // Signal dispatch, excluding callbacks
+	alloc_callback,  // Slot callbacks called during an invoke
+	alloc_queue,     // pushing events to a queue or batch
+	alloc_copy,      // copying event data
+	alloc_n_ops
+};
+
+class AllocScope
+{
+public:
+
+	static const unsigned max_depth = 64;
+
+	AllocScope( AllocOp op ) { push(op); }
+	~AllocScope() { pop(); }
+
+	AllocScope( const AllocScope& ) = delete;
+	AllocScope& operator= ( const AllocScope& ) = delete;
+
+	static void push( AllocOp op )
+	{
+		Stack& s = _stack();
+		if ( s.depth < max_depth ) s.ops[s.depth] = op;
+		++s.depth;
+	}
+	static void pop()
+	{
+		Stack& s = _stack();
+		if ( s.depth ) --s.depth;
+	}
+
+	// Operation in progress on the calling thread
+	static AllocOp current()
+	{
+		const Stack& s = _stack();
+		return s.depth ? s.ops[ (s.depth < max_depth ? s.depth : max_depth) - 1 ] : alloc_other;
+	}
+
+private:
+
+	// Plain data, so that it never allocates
+	struct Stack
+	{
+		unsigned depth;
+		AllocOp ops[max_depth];
+	};
+	static Stack& _stack() { static thread_local Stack s = {}; return s; }
+};
+
+#ifdef SIGLOT_INSTRUMENT
+#define SIGLOT_ALLOC_SCOPE( op ) siglot::AllocScope _siglot_alloc_scope( siglot::op )
+#else
+#define SIGLOT_ALLOC_SCOPE( op )
+#endif
+
+
+
+class SlotSetCore;
+class Wiring;
+
 /**
  * The Slot interface as seen by a Signal object.
+ *
+ * Subscription management does not depend on the data type, so it is 
+ * implemented once, here and in SlotSetCore, for all Signals and Slots.
+ * The typed classes below only add the signature of the callback; this
+ * keeps the code generated per data type to a minimum.
+ *
+ * This interface provides the methods:
+ * - unsubscribe: from registered Signal
+ * - is_active  : checks whether the Slot is subscribed
  */
-template <typename data_type>
-class CallbackInterface
+class ListenerCore
 {
 public:
 
-	CallbackInterface(): active(false) {}
+	ListenerCore(): active(false), signal(nullptr) {}
+
+	// Ask Signal to remove the current Slot from its set
+	// and switch to "inactive" state
+	void unsubscribe();
+
+	// Check current state
+	inline virtual bool is_active() const { return _is_active(); }
 
 protected:
 
-	template <typename U> friend class Signal;
+	friend class SlotSetCore;
+	friend class Wiring;
 
 	// Is the Callback subscribed to a Signal?
 	mutable bool active;
+	SlotSetCore *signal;
 
 	// Used upon Signal destruction to deactivate subscribed Slots
 	inline void _deactivate() { active = false; }
 
-	// Trigger the callback function
-	virtual void operator() ( const data_type& data ) =0;
+	// Subscribe to a specific signal (type-checked by ListenerInterface)
+	void _subscribe( SlotSetCore *s );
+
+	// Internal inherited methods to check the current state
+	inline bool _is_active() const { return this->active = (this->active && signal); }
+
+	// Copy the Signal registered in a sibling
+	inline void _copy( const ListenerCore *other )
+	{
+		if ( other != this && other->_is_active() )
+			_subscribe( other->signal );
+	}
+};
+
+
+
+/**
+ * Storage of the subscribers of a Signal, in one of three forms:
+ * - small  : up to small_size Slots inside the object, without allocation;
+ * - flat   : a sorted contiguous array, fastest to iterate, but insertions
+ *            and removals move half of the array on average;
+ * - indexed: a set, with insertion and removal in logarithmic time, but
+ *            slower to iterate.
+ *
+ * The storage counts modifications and invocations, and every "window"
+ * events compares the cost of the current form with the alternative, under a
+ * simple cost model (in ns). The difference accumulates as regret (never below zero), and the
+ * storage converts once the regret exceeds the cost of the conversion: a
+ * Signal only changes form when its access pattern has paid for it, and a
+ * stable pattern never makes it flip back and forth.
+ *
+ * By default, the form is only re-evaluated on modification, and invocations
+ * only count up to a full window (a relaxed atomic, which is no longer
+ * written once the window is full). A Signal may therefore be invoked from
+ * several threads at once, as long as its subscriptions do not change
+ * meanwhile. In adaptive mode, the form is also re-evaluated at the end of
+ * an emission, so a Signal that is only invoked still converts. Modifications made by the callbacks
+ * of an emission are deferred until the emission ends: Slots removed are no
+ * longer called, Slots added are called from the next emission, and the
+ * storage never moves or converts while it is iterated.
+ *
+ * Bulk wiring (siglot_wiring.h) assigns the flat form directly.
+ */
+class SlotStorage
+{
+public:
+
+	typedef ListenerCore* slot_ptr;
+	enum Form { small, flat, indexed };
+
+	static const unsigned small_size = 4;
+	static const unsigned window     = 64;
+
+	SlotStorage(): current(small), n_small(0), tuned(false), invokes(0), changes(0), regret(0) {}
+
+	// Copies hold the current subscribers, without pending modifications
+	SlotStorage( const SlotStorage& other ): current(small), n_small(0), tuned(other.tuned), invokes(0), changes(0), regret(0)
+	{
+		*this = other;
+	}
+
+	SlotStorage& operator= ( const SlotStorage& other )
+	{
+		if ( &other == this ) return *this;
+
+		std::vector<slot_ptr> tmp;
+		other.each( [&]( slot_ptr s ) { tmp.push_back(s); } );
+		std::sort( tmp.begin(), tmp.end() );
+
+		if ( _iterating() ) { assign(tmp); return *this; }
+
+		clear();
+		if ( other.current == indexed ) { index.insert( tmp.begin(), tmp.end() ); current = indexed; }
+		else if ( tmp.size() <= small_size ) { std::copy( tmp.begin(), tmp.end(), smalls ); n_small = tmp.size(); }
+		else assign(tmp);
+		return *this;
+	}
+
+	inline Form form() const { return current; }
+
+	// Also tune the form at the end of emissions (the Signal must then not be
+	// invoked from several threads at once)
+	inline void adaptive( bool on ) { tuned = on; }
+	inline bool adaptive() const { return tuned; }
+
+	inline unsigned size() const
+	{
+		return _base_size() - removed.size() + added.size();
+	}
+
+	bool contains( slot_ptr s ) const
+	{
+		if ( !added.empty() && std::binary_search( added.begin(), added.end(), s ) ) return true;
+		if ( !removed.empty() && std::binary_search( removed.begin(), removed.end(), s ) ) return false;
+		return _base_contains(s);
+	}
+
+	void insert( slot_ptr s )
+	{
+		SIGLOT_ALLOC_SCOPE( alloc_subscribe );
+		_modified();
+		if ( _iterating() )
+		{
+			if ( _drop( removed, s ) ) return;
+			if ( !_base_contains(s) ) _add( added, s );
+			return;
+		}
+		_compact();
+		_base_insert(s);
+	}
+
+	void erase( slot_ptr s )
+	{
+		SIGLOT_ALLOC_SCOPE( alloc_subscribe );
+		_modified();
+		if ( _iterating() )
+		{
+			if ( _drop( added, s ) ) return;
+			if ( _base_contains(s) ) _add( removed, s );
+			return;
+		}
+		_compact();
+		_base_erase(s);
+	}
+
+	void clear()
+	{
+		if ( _iterating() )
+		{
+			added.clear();
+			removed.clear();
+			_base_each( [this]( slot_ptr s ) { removed.push_back(s); } );
+			std::sort( removed.begin(), removed.end() );
+			return;
+		}
+
+		index.clear();
+		std::vector<slot_ptr>().swap(array);
+		std::vector<slot_ptr>().swap(added);
+		std::vector<slot_ptr>().swap(removed);
+		current = small;
+		n_small = invokes = changes = 0;
+		regret  = 0;
+	}
+
+	// Replace the contents with a sorted array without duplicates
+	void assign( std::vector<slot_ptr>& sorted )
+	{
+		SIGLOT_ALLOC_SCOPE( alloc_subscribe );
+		if ( _iterating() )
+		{
+			clear();
+			added.swap(sorted);
+			return;
+		}
+
+		index.clear();
+		added.clear();
+		removed.clear();
+		array.swap(sorted);
+		current = flat;
+		n_small = 0;
+	}
+
+	// Apply a function to each slot (read-only: the function must not modify
+	// the storage, see dispatch)
+	template <typename F>
+	inline void each( F f ) const
+	{
+		_base_each( [&]( slot_ptr s ) { if ( !_removed(s) ) f(s); } );
+		for ( auto s: added ) f(s);
+	}
+
+	// Same, until the function returns false
+	template <typename F>
+	void each_while( F f ) const
+	{
+		if ( !_base_while( [&]( slot_ptr s ) { return _removed(s) || f(s); } ) ) return;
+		for ( auto s: added ) if ( !f(s) ) return;
+	}
+
+	// Call a function for each slot subscribed when the emission starts; the
+	// function may modify the storage (the changes are applied at the end)
+	template <typename F>
+	inline void dispatch( F f ) const
+	{
+		const unsigned n = invokes.load(std::memory_order_relaxed);
+		if ( n < window ) invokes.store( n+1, std::memory_order_relaxed );
+
+		{
+			Frame frame(this);
+			_base_each( [&]( slot_ptr s ) { if ( !_removed(s) ) f(s); } );
+		}
+		if ( !( added.empty() && removed.empty() ) && !_iterating() ) _compact();
+		if ( tuned && n+1 + changes >= window && !_iterating() ) { _compact(); _tune(); }
+	}
+
+private:
+
+	// Storages being iterated by the calling thread (innermost last)
+	static const unsigned frames_size = 64;
+	struct Frames
+	{
+		const SlotStorage *items[frames_size];
+		unsigned depth;
+	};
+
+	inline static Frames& _frames()
+	{
+		static thread_local Frames f = { {}, 0 };
+		return f;
+	}
+
+	struct Frame
+	{
+		Frame( const SlotStorage *s )
+		{
+			Frames& f = _frames();
+			if ( f.depth < frames_size ) f.items[f.depth] = s;
+			++f.depth;
+		}
+		~Frame() { --_frames().depth; }
+	};
+
+	// Is this storage being iterated by the calling thread? (assumed so when
+	// emissions are nested too deeply to be recorded)
+	inline bool _iterating() const
+	{
+		const Frames& f = _frames();
+		if ( f.depth > frames_size ) return true;
+		for ( unsigned i = 0; i < f.depth; ++i )
+			if ( f.items[i] == this ) return true;
+		return false;
+	}
+
+	// The form may change on any modification, including deferred ones
+	mutable Form current;
+	mutable slot_ptr smalls[small_size];
+	mutable unsigned n_small;
+	mutable std::vector<slot_ptr> array;
+	mutable std::set<slot_ptr> index;
+
+	// Modifications deferred during an emission (sorted)
+	mutable std::vector<slot_ptr> added, removed;
+
+	bool tuned;
+	mutable std::atomic<unsigned> invokes;
+	mutable unsigned changes;
+	mutable double regret;
+
+	inline static void _add( std::vector<slot_ptr>& v, slot_ptr s )
+	{
+		auto it = std::lower_bound( v.begin(), v.end(), s );
+		if ( it == v.end() || *it != s ) v.insert( it, s );
+	}
+	inline static bool _drop( std::vector<slot_ptr>& v, slot_ptr s )
+	{
+		auto it = std::lower_bound( v.begin(), v.end(), s );
+		if ( it == v.end() || *it != s ) return false;
+		v.erase(it);
+		return true;
+	}
+	inline bool _removed( slot_ptr s ) const
+	{
+		return !removed.empty() && std::binary_search( removed.begin(), removed.end(), s );
+	}
+
+	inline unsigned _base_size() const
+	{
+		switch ( current )
+		{
+			case small: return n_small;
+			case flat : return array.size();
+			default   : return index.size();
+		}
+	}
+
+	bool _base_contains( slot_ptr s ) const
+	{
+		switch ( current )
+		{
+			case small: return std::find( smalls, smalls + n_small, s ) != smalls + n_small;
+			case flat : return std::binary_search( array.begin(), array.end(), s );
+			default   : return index.count(s);
+		}
+	}
+
+	template <typename F>
+	inline void _base_each( F f ) const
+	{
+		switch ( current )
+		{
+			case small: for ( unsigned i = 0; i < n_small; ++i ) f( smalls[i] ); break;
+			case flat : for ( auto s: array ) f(s); break;
+			default   : for ( auto s: index ) f(s);
+		}
+	}
+
+	// Returns false if stopped by the function
+	template <typename F>
+	bool _base_while( F f ) const
+	{
+		switch ( current )
+		{
+			case small: for ( unsigned i = 0; i < n_small; ++i ) if ( !f( smalls[i] ) ) return false; break;
+			case flat : for ( auto s: array ) if ( !f(s) ) return false; break;
+			default   : for ( auto s: index ) if ( !f(s) ) return false;
+		}
+		return true;
+	}
+
+	void _base_insert( slot_ptr s ) const
+	{
+		if ( current == small )
+		{
+			if ( _base_contains(s) ) return;
+			if ( n_small < small_size ) { smalls[n_small++] = s; return; }
+			_convert(flat);
+		}
+
+		if ( current == flat ) _add( array, s );
+		else index.insert(s);
+	}
+
+	void _base_erase( slot_ptr s ) const
+	{
+		if ( current == small )
+		{
+			slot_ptr *it = std::find( smalls, smalls + n_small, s );
+			if ( it != smalls + n_small ) { std::copy( it + 1, smalls + n_small, it ); --n_small; }
+		}
+		else if ( current == flat ) _drop( array, s );
+		else index.erase(s);
+	}
+
+	// Apply the modifications deferred during emissions
+	void _compact() const
+	{
+		if ( added.empty() && removed.empty() ) return;
+		SIGLOT_ALLOC_SCOPE( alloc_subscribe );
+
+		std::vector<slot_ptr> a, r;
+		a.swap(added);
+		r.swap(removed);
+		for ( auto s: r ) _base_erase(s);
+		for ( auto s: a ) _base_insert(s);
+
+		// Keep the buffers for the next emissions
+		a.clear(); r.clear();
+		added.swap(a);
+		removed.swap(r);
+	}
+
+	inline void _modified() const
+	{
+		++changes;
+		if ( invokes.load(std::memory_order_relaxed) + changes >= window && !_iterating() ) { _compact(); _tune(); }
+	}
+
+	// Estimated cost of the last window in a given form
+	double _cost( Form f, double n ) const
+	{
+		const double invokes = this->invokes.load(std::memory_order_relaxed);
+		if ( f == flat ) return invokes * n + changes * (8 + n / 8);
+		return invokes * n * 3 + changes * (60 + 4 * std::log2(n + 1));
+	}
+
+	void _tune() const
+	{
+		const unsigned n = size();
+		if ( n <= small_size )
+		{
+			if ( current != small ) _convert(small);
+		}
+		else
+		{
+			const Form other = current == flat ? indexed : flat;
+			regret += _cost(current,n) - _cost(other,n);
+			if ( regret < 0 ) regret = 0;
+
+			if ( regret > (other == indexed ? 60.0 : 2.0) * n ) _convert(other);
+		}
+		invokes = changes = 0;
+	}
+
+	// Never called while the storage is iterated
+	void _convert( Form f ) const
+	{
+		SIGLOT_ALLOC_SCOPE( alloc_subscribe );
+		std::vector<slot_ptr> tmp;
+		tmp.reserve( _base_size() );
+		_base_each( [&]( slot_ptr s ) { tmp.push_back(s); } );
+		std::sort( tmp.begin(), tmp.end() );
+
+		index.clear();
+		std::vector<slot_ptr>().swap(array);
+
+		switch ( current = f )
+		{
+			case small: n_small = tmp.size(); std::copy( tmp.begin(), tmp.end(), smalls ); break;
+			case flat : array.swap(tmp); break;
+			default   : index.insert( tmp.begin(), tmp.end() );
+		}
+		regret = 0;
+	}
 };
 
 
@@ -51,41 +633,119 @@ protected:
 /**
  * The Signal interface as seen by a Slot object.
  * 
- * A Signal stores its subscribers (Slots) as a set of pointers to 
- * CallbackInterfaces. This allows to avoid duplicates, and to access 
- * specific Slots (eg for deactivation) in logarithmic time.
+ * A Signal stores its subscribers (Slots) as pointers to ListenerCores in a
+ * SlotStorage. This allows to avoid duplicates, and to access specific Slots
+ * (eg for deactivation) in logarithmic time.
  *
  * This interface provides the methods:
  * - _subscribe  : a new Slot subscribes to the Signal
  * - _unsubscribe: a specific Slot unsubscribes
+ * - _clear      : deactivate and remove all Slots
  * - count       : returns the number of currently subscribed Slots
+ * - revision    : changes whenever the set of Slots is modified
  */
-template <typename data_type>
-class SlotSet
+class SlotSetCore
 {
 public:
 
-	typedef CallbackInterface<data_type> slot_type;
-	typedef slot_type* slot_ptr;
-	typedef SlotSet<data_type> self;
+	SlotSetCore(): changes(0) {}
 
 	// Count number of slots currently subscribed
 	inline unsigned count() const { return slots.size(); }
 
+	// Number of modifications of the slot set so far
+	inline unsigned long revision() const { return changes; }
+
+	// Current form of the subscriber storage
+	inline SlotStorage::Form storage() const { return slots.form(); }
+
+	// Also tune the storage at the end of emissions; invoke may then convert
+	// it, and must not be called from several threads at once
+	inline void adaptive( bool on ) { slots.adaptive(on); }
+
 protected:
 
-	template <typename U> friend class ListenerInterface;
+	friend class ListenerCore;
+	friend class Wiring;
 
 	// Copy the list of slots
-	inline void _copy( const self *other )
+	inline void _copy( const SlotSetCore *other )
 	{
-		if ( other != this ) slots = other->slots;
+		if ( other != this ) { slots = other->slots; ++changes; }
+	}
+
+	// Disconnect all slots
+	void _clear()
+	{
+		slots.each( [this]( ListenerCore *slot ) {
+			SIGLOT_PROBE( unsubscribe, this, slot );
+			slot->_deactivate();
+		});
+		slots.clear();
+		++changes;
 	}
 
 	// Insertion/deletion in the slot set
-	std::set<slot_ptr> slots;
-	inline void _subscribe( slot_ptr s ) { slots.insert(s); }
-	inline void _unsubscribe( slot_ptr s ) { slots.erase(s); }
+	SlotStorage slots;
+	unsigned long changes;
+	inline void _subscribe( ListenerCore *s ) { slots.insert(s); ++changes; }
+	inline void _unsubscribe( ListenerCore *s ) { slots.erase(s); ++changes; }
+};
+
+inline void ListenerCore::unsubscribe()
+{
+	if ( _is_active() ) 
+	{
+		SIGLOT_PROBE( unsubscribe, signal, this );
+		signal->_unsubscribe(this);
+	}
+	_deactivate();
+	signal = nullptr;
+}
+
+inline void ListenerCore::_subscribe( SlotSetCore *s )
+{
+	signal = s;
+	s->_subscribe(this);
+	active = true;
+	SIGLOT_PROBE( subscribe, s, this );
+}
+
+
+
+/**
+ * Typed interfaces: the callback signature of a Slot, and the set of Slots
+ * of a Signal, for a given data type.
+ */
+template <typename data_type>
+class CallbackInterface
+	: public ListenerCore
+{
+protected:
+
+	template <typename U> friend class SlotSet;
+
+	// Trigger the callback function
+	virtual void operator() ( const data_type& data ) =0;
+};
+
+template <typename data_type>
+class SlotSet
+	: public SlotSetCore
+{
+public:
+
+	typedef CallbackInterface<data_type> slot_type;
+	typedef slot_type* slot_ptr;
+	typedef SlotSet<data_type> self;
+
+protected:
+
+	// Trigger one callback (for Signals and for sets with their own dispatch)
+	inline static void _call( ListenerCore *slot, const data_type& data )
+	{
+		(*static_cast<slot_ptr>(slot))(data);
+	}
 };
 
 
@@ -93,7 +753,7 @@ protected:
 /**
  * Defines Slot-actions related to a Signal:
  * - unsubscribe: from registered Signal
- * - subscribe  : to Signal
+ * - subscribe  : to Signal (with the same data type only)
  */
 template <typename data_type>
 class ListenerInterface 
@@ -105,39 +765,13 @@ public:
 	typedef signal_type* signal_ptr;
 	typedef ListenerInterface<data_type> self;
 
-	// Ask Signal to remove the current Slot from its set
-	// and switch to "inactive" state
-	void unsubscribe()
-	{
-		if ( _is_active() ) signal->_unsubscribe(this);
-		this->_deactivate();
-		signal = nullptr;
-	}
-
 	// Subscribe to a specific signal
-	void subscribe( signal_ptr s )
-	{
-		signal = s;
-		s->_subscribe(this);
-		this->active = true;
-	}
-
-	// Check current state
-	inline virtual bool is_active() const { return _is_active(); }
+	inline void subscribe( signal_ptr s ) { this->_subscribe(s); }
 
 protected:
 
-	// Internal inherited methods to check the current state
-	inline bool _is_active() const { return this->active = (this->active && signal); }
-
 	// Copy the Signal registered in a sibling
-	void _copy( const self *other )
-	{
-		if ( other != this && other->_is_active() )
-			subscribe( other->signal );
-	}
-
-	signal_ptr signal;
+	inline void _copy( const self *other ) { ListenerCore::_copy(other); }
 };
 
 
@@ -196,27 +830,29 @@ public:
 
 	data_type data;
 
-	Signal() {}
-	~Signal() { clear(); }
+	Signal() { SIGLOT_PROBE( signal_create, this ); }
+	~Signal() { clear(); SIGLOT_PROBE( signal_destroy, this ); }
 
 	// Nothing is done by default on copy/assignment
-	Signal( const self& other ) {}
+	Signal( const self& other ) { SIGLOT_PROBE( signal_create, this ); }
 	self& operator= ( const self& other ) {}
 
 	// Copy of the slots set should be explicitly called
 	inline void copy( const self& other ) { this->_copy( &other ); }
 
 	// Disconnect all slots on cleanup
-	void clear()
-	{ 
-		for ( auto slot : this->slots ) slot->_deactivate();
-		this->slots.clear();
-	}
+	inline void clear() { this->_clear(); }
 
 	// Trigger the signal and invoke all callback functions
 	void invoke() const
 	{
-		for ( auto slot : this->slots ) (*slot)(data);
+		SIGLOT_PROBE( emit_begin, this, this->count() );
+		this->slots.dispatch( [this]( ListenerCore *slot ) {
+			SIGLOT_PROBE( slot_begin, this, slot );
+			self::_call( slot, data );
+			SIGLOT_PROBE( slot_end, this, slot );
+		});
+		SIGLOT_PROBE( emit_end, this );
 	}
 };
 
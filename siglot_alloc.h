@@ -0,0 +1,227 @@
+#ifndef __SIGLOT_ALLOC__
+#define __SIGLOT_ALLOC__
+
+#include "siglot.h"
+
+#include <new>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+
+//=============================================
+// @filename     siglot_alloc.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+inline const char* alloc_op_name( AllocOp op )
+{
+	static const char *names[] = { "other", "subscribe", "invoke", "callback", "queue", "copy" };
+	return op < alloc_n_ops ? names[op] : "?";
+}
+
+
+
+/**
+ * Debug/benchmark mode counting heap allocations by operation.
+ *
+ * Allocations are seen through the replacement operators new/delete, which
+ * are defined by the translation unit that includes this header after
+ * defining SIGLOT_ALLOC_HOOKS (exactly one per program).
+ *
+ * Operations are known from the probe hooks for invoke (see siglot.h,
+ * SIGLOT_INSTRUMENT) once the tracker is installed, and from the AllocScope
+ * markers (see siglot.h): siglot marks the changes of Signal storage, its
+ * queues and its copies of event data. User code may mark its own
+ * operations with an AllocScope as well.
+ *
+ * Signals can be watched, in which case any allocation during their invoke
+ * (including nested callbacks) is a violation, reported to the handler; the
+ * default handler aborts the program.
+ *
+ * NOTE:
+ * The tracker never allocates itself: all its state has a fixed size.
+ * Over-aligned allocations (C++17) are not intercepted.
+ */
+class AllocTracker
+	: public Probe
+{
+public:
+
+	typedef void (*handler_type)( const void *signal, std::size_t bytes );
+
+	static const unsigned max_watched = 64;
+	static const unsigned max_depth   = 64;
+
+	// The tracker is global, like the allocation operators
+	static AllocTracker& instance() { static AllocTracker t; return t; }
+
+	AllocTracker( const AllocTracker& other ) = delete;
+	AllocTracker& operator= ( const AllocTracker& other ) = delete;
+
+	// Start/stop counting (counting is off initially)
+	inline void enable( bool on = true ) { enabled.store( on, std::memory_order_relaxed ); }
+
+	// Reset all counters (watched Signals are kept)
+	void reset()
+	{
+		for ( unsigned i = 0; i < alloc_n_ops; ++i )
+		{
+			counts[i].store( 0, std::memory_order_relaxed );
+			sizes[i].store( 0, std::memory_order_relaxed );
+		}
+		for ( unsigned i = 0; i < max_watched; ++i )
+			watched[i].count.store( 0, std::memory_order_relaxed );
+	}
+
+	// Allocations and bytes attributed to an operation
+	inline uint64_t count( AllocOp op ) const { return counts[op].load(std::memory_order_relaxed); }
+	inline uint64_t bytes( AllocOp op ) const { return sizes[op].load(std::memory_order_relaxed); }
+
+	// Require invoke() on a given Signal not to allocate
+	bool watch( const void *signal )
+	{
+		for ( unsigned i = 0; i < max_watched; ++i )
+		{
+			const void *cur = nullptr;
+			if ( watched[i].signal.compare_exchange_strong( cur, signal ) || cur == signal )
+				return true;
+		}
+		return false;
+	}
+
+	// Number of allocations during invoke() on a watched Signal
+	uint64_t violations( const void *signal ) const
+	{
+		for ( unsigned i = 0; i < max_watched; ++i )
+			if ( watched[i].signal.load(std::memory_order_relaxed) == signal )
+				return watched[i].count.load(std::memory_order_relaxed);
+		return 0;
+	}
+
+	// Called on violations; nullptr to only count them
+	inline void on_violation( handler_type h ) { handler = h; }
+
+	// Called by the replacement operators new
+	static void record( std::size_t n )
+	{
+		AllocTracker& t = instance();
+		if ( !t.enabled.load(std::memory_order_relaxed) ) return;
+
+		State& s = _state();
+		if ( s.busy ) return;
+		s.busy = true;
+
+		AllocOp op = AllocScope::current();
+		t.counts[op].fetch_add( 1, std::memory_order_relaxed );
+		t.sizes[op].fetch_add( n, std::memory_order_relaxed );
+
+		// Any watched Signal being invoked on this thread is concerned
+		unsigned k = s.emits < max_depth ? s.emits : max_depth;
+		for ( unsigned e = 0; e < k; ++e )
+			for ( unsigned i = 0; i < max_watched; ++i )
+				if ( s.signals[e] && t.watched[i].signal.load(std::memory_order_relaxed) == s.signals[e] )
+				{
+					t.watched[i].count.fetch_add( 1, std::memory_order_relaxed );
+					if ( t.handler ) t.handler( s.signals[e], n );
+				}
+		s.busy = false;
+	}
+
+	void emit_begin( const void *signal, unsigned )
+	{
+		State& s = _state();
+		if ( s.emits < max_depth ) s.signals[s.emits] = signal;
+		++s.emits;
+		AllocScope::push( alloc_invoke );
+	}
+	void emit_end( const void* )
+	{
+		State& s = _state();
+		if ( s.emits ) --s.emits;
+		AllocScope::pop();
+	}
+	void slot_begin( const void*, const void* ) { AllocScope::push( alloc_callback ); }
+	void slot_end( const void*, const void* ) { AllocScope::pop(); }
+
+protected:
+
+	AllocTracker(): enabled(false), handler(&_abort)
+	{
+		for ( unsigned i = 0; i < alloc_n_ops; ++i ) { counts[i] = 0; sizes[i] = 0; }
+	}
+
+	static void _abort( const void *signal, std::size_t bytes )
+	{
+		std::fprintf( stderr, "siglot: %zu bytes allocated during invoke() of watched signal %p\n",
+			bytes, signal );
+		std::abort();
+	}
+
+	// Per-thread state; plain data, so that it never allocates
+	struct State
+	{
+		bool busy; // recording (eg the handler allocates)
+		unsigned emits;
+		const void *signals[max_depth];
+	};
+	static State& _state() { static thread_local State s = {}; return s; }
+
+	struct Watched
+	{
+		std::atomic<const void*> signal;
+		std::atomic<uint64_t> count;
+		Watched(): signal(nullptr), count(0) {}
+	};
+
+	std::atomic<bool> enabled;
+	handler_type handler;
+	std::atomic<uint64_t> counts[alloc_n_ops];
+	std::atomic<uint64_t> sizes[alloc_n_ops];
+	Watched watched[max_watched];
+};
+
+
+}
+
+
+
+/**
+ * Replacement allocation operators, defined once per program.
+ */
+#ifdef SIGLOT_ALLOC_HOOKS
+
+void* operator new( std::size_t n )
+{
+	siglot::AllocTracker::record(n);
+	if ( void *p = std::malloc( n ? n : 1 ) ) return p;
+	throw std::bad_alloc();
+}
+void* operator new[]( std::size_t n ) { return ::operator new(n); }
+
+void* operator new( std::size_t n, const std::nothrow_t& ) noexcept
+{
+	siglot::AllocTracker::record(n);
+	return std::malloc( n ? n : 1 );
+}
+void* operator new[]( std::size_t n, const std::nothrow_t& t ) noexcept { return ::operator new(n,t); }
+
+void operator delete( void *p ) noexcept { std::free(p); }
+void operator delete[]( void *p ) noexcept { std::free(p); }
+void operator delete( void *p, const std::nothrow_t& ) noexcept { std::free(p); }
+void operator delete[]( void *p, const std::nothrow_t& ) noexcept { std::free(p); }
+
+#ifdef __cpp_sized_deallocation
+void operator delete( void *p, std::size_t ) noexcept { std::free(p); }
+void operator delete[]( void *p, std::size_t ) noexcept { std::free(p); }
+#endif
+
+#endif
+
+#endif
@@ -0,0 +1,255 @@
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+
+using namespace std;
+
+//=============================================
+// Offline analysis of the traces exported by TraceProbe (siglot_trace.h).
+//
+// Reconstructs the causal cascades (emit -> slot -> nested emit) of each
+// root emission, and reports for the slowest ones: the critical path, the
+// cascade depth, the fan-out amplification, and the top contributors to
+// their end-to-end latency.
+//
+// Usage: siglot_analyze trace.json [top=10]
+//=============================================
+
+
+
+/**
+ * A span of the trace: either an emission or a slot callback.
+ * Emissions contain slot callbacks, which contain nested emissions.
+ */
+struct Span
+{
+    bool is_slot;
+    string name;    // label of the signal or the slot
+    string signal;  // label of the signal
+    double begin, end; // us
+
+    vector< unique_ptr<Span> > children;
+
+    inline double duration() const { return end - begin; }
+
+    double self() const
+    {
+        double t = duration();
+        for ( auto& c: children ) t -= c->duration();
+        return t;
+    }
+};
+
+/**
+ * Summary of the cascade triggered by a root emission.
+ */
+struct Cascade
+{
+    Span *root;
+    unsigned tid;
+    unsigned depth;      // maximum number of nested emissions
+    unsigned emits;      // emissions in the cascade (including the root)
+    unsigned deliveries; // slot callbacks in the cascade
+    map<string,double> self_time; // by slot (and dispatch by signal), us
+};
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+/**
+ * Extract the value of "key" from a line of the trace (one event per line).
+ * Strings are unescaped; numbers are returned as written.
+ */
+bool field( const string& line, const string& key, string& out )
+{
+    size_t p = line.find( "\"" + key + "\":" );
+    if ( p == string::npos ) return false;
+    p += key.size() + 3;
+
+    out.clear();
+    if ( p < line.size() && line[p] == '"' )
+    {
+        for ( ++p; p < line.size() && line[p] != '"'; ++p )
+        {
+            if ( line[p] == '\\' && p+1 < line.size() ) ++p;
+            out += line[p];
+        }
+        return true;
+    }
+
+    while ( p < line.size() && line[p] != ',' && line[p] != '}' ) out += line[p++];
+    return !out.empty();
+}
+
+/**
+ * Rebuild the span trees of each thread from the begin/end events.
+ */
+vector< pair<unsigned, unique_ptr<Span> > > parse( istream& is )
+{
+    vector< pair<unsigned, unique_ptr<Span> > > roots;
+    map< unsigned, vector<Span*> > stacks;
+
+    string line, ph, tid, ts, cat, name, signal;
+    while ( getline(is,line) )
+    {
+        if ( !field(line,"ph",ph) || (ph != "B" && ph != "E") ) continue;
+        if ( !field(line,"tid",tid) || !field(line,"ts",ts) ) continue;
+
+        unsigned t = atoi(tid.c_str());
+        vector<Span*>& stack = stacks[t];
+
+        if ( ph == "E" )
+        {
+            if ( stack.empty() ) continue;
+            stack.back()->end = atof(ts.c_str());
+            stack.pop_back();
+            continue;
+        }
+
+        field(line,"cat",cat); field(line,"name",name); field(line,"signal",signal);
+
+        unique_ptr<Span> s( new Span() );
+        s->is_slot = cat == "slot";
+        s->name    = name;
+        s->signal  = signal;
+        s->begin   = s->end = atof(ts.c_str());
+
+        Span *p = s.get();
+        if ( stack.empty() )
+        {
+            if ( s->is_slot ) continue; // callback whose emission was not recorded
+            roots.emplace_back( t, move(s) );
+        }
+        else stack.back()->children.push_back( move(s) );
+        stack.push_back(p);
+    }
+    return roots;
+}
+
+void summarize( const Span& s, Cascade& c, unsigned depth )
+{
+    if ( s.is_slot )
+    {
+        ++c.deliveries;
+        c.self_time[s.name] += s.self();
+    }
+    else
+    {
+        ++c.emits;
+        c.depth = max( c.depth, depth );
+        c.self_time["[dispatch] " + s.name] += s.self();
+    }
+
+    for ( auto& child: s.children )
+        summarize( *child, c, depth + !s.is_slot );
+}
+
+/**
+ * Callbacks run synchronously, so the latency of a span is the sum of its
+ * children; the critical path follows the most expensive child at each level.
+ */
+vector<const Span*> critical_path( const Span& root )
+{
+    vector<const Span*> path( 1, &root );
+    for ( const Span *s = &root; !s->children.empty(); path.push_back(s) )
+        s = max_element( s->children.begin(), s->children.end(),
+            []( const unique_ptr<Span>& a, const unique_ptr<Span>& b ){
+                return a->duration() < b->duration(); } )->get();
+    return path;
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+int main( int argc, char *argv[] )
+{
+    if ( argc < 2 )
+    {
+        cerr << "Usage: " << argv[0] << " trace.json [top=10]" << endl;
+        return 1;
+    }
+
+    ifstream in( argv[1] );
+    if ( !in )
+    {
+        cerr << "Could not open " << argv[1] << endl;
+        return 1;
+    }
+    unsigned top = argc > 2 ? atoi(argv[2]) : 10;
+
+    auto roots = parse(in);
+    vector<Cascade> cascades;
+    for ( auto& r: roots )
+    {
+        Cascade c = {};
+        c.root = r.second.get();
+        c.tid  = r.first;
+        summarize( *c.root, c, 1 );
+        cascades.push_back(c);
+    }
+
+    sort( cascades.begin(), cascades.end(), []( const Cascade& a, const Cascade& b ){
+        return a.root->duration() > b.root->duration(); } );
+
+    /**
+     * Aggregate by root signal.
+     */
+    struct Total { unsigned n, depth; double time, worst, deliveries; };
+    map<string,Total> totals;
+    for ( auto& c: cascades )
+    {
+        Total& t = totals[c.root->name];
+        t.n++; t.time += c.root->duration(); t.deliveries += c.deliveries;
+        t.worst = max( t.worst, c.root->duration() );
+        t.depth = max( t.depth, c.depth );
+    }
+
+    cout << fixed << setprecision(3);
+    cout << "root events: " << cascades.size() << "\n\n";
+    cout << left << setw(32) << "ROOT SIGNAL" << right << setw(8) << "COUNT" << setw(14) << "MEAN(us)"
+         << setw(14) << "MAX(us)" << setw(8) << "DEPTH" << setw(14) << "AMPLIFICATION" << "\n";
+    for ( auto& t: totals )
+        cout << left << setw(32) << t.first.substr(0,31) << right << setw(8) << t.second.n
+             << setw(14) << t.second.time / t.second.n << setw(14) << t.second.worst
+             << setw(8) << t.second.depth << setw(14) << t.second.deliveries / t.second.n << "\n";
+
+    /**
+     * Details of the slowest cascades.
+     */
+    for ( unsigned i = 0; i < cascades.size() && i < top; ++i )
+    {
+        const Cascade& c = cascades[i];
+        cout << "\n#" << i+1 << " " << c.root->name << " (thread " << c.tid << ") at "
+             << c.root->begin << " us: " << c.root->duration() << " us, depth " << c.depth
+             << ", " << c.emits << " emits, " << c.deliveries << " deliveries\n";
+
+        cout << "  critical path:\n";
+        for ( auto s: critical_path(*c.root) )
+            cout << "    " << (s->is_slot ? "slot   " : "signal ") << setw(12) << s->duration()
+                 << " us  " << s->name << "\n";
+
+        vector< pair<double,string> > contrib;
+        for ( auto& t: c.self_time ) contrib.emplace_back( t.second, t.first );
+        sort( contrib.rbegin(), contrib.rend() );
+
+        cout << "  top contributors (self time):\n";
+        for ( unsigned k = 0; k < contrib.size() && k < 5; ++k )
+            cout << "    " << setw(12) << contrib[k].first << " us  "
+                 << setw(5) << setprecision(1) << 100 * contrib[k].first / max(c.root->duration(), 1e-9)
+                 << "%  " << setprecision(3) << contrib[k].second << "\n";
+    }
+}
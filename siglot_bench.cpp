@@ -0,0 +1,208 @@
+#include "siglot.h"
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+using namespace siglot;
+
+//=============================================
+// Microbenchmarks of the dispatch, subscription and payload paths.
+//
+// Each case is calibrated to run for at least "min_ms" milliseconds, then
+// repeated "reps" times; the output is CSV on stdout:
+//
+//     benchmark,param,ops,min_ns_per_op,median_ns_per_op,mops_per_sec
+//
+// where "ops" counts callbacks for dispatch cases, and subscribe+unsubscribe
+// pairs for churn cases.
+//
+// Usage: siglot_bench [min_ms=50] [reps=5] [filter]
+//=============================================
+
+
+
+unsigned min_ms = 50, reps = 5;
+string filter;
+
+/**
+ * Callbacks increment a global counter, which prevents the compiler from
+ * optimizing the calls away.
+ */
+volatile uint64_t sink = 0;
+
+template <unsigned N> struct Payload { char bytes[N]; };
+
+template <typename T> void plain_callback( const T& ) { sink = sink + 1; }
+void void_callback() { sink = sink + 1; }
+
+template <typename T> struct Receiver
+{
+    MemberSlot<Receiver,T> slot;
+    void callback( const T& ) { sink = sink + 1; }
+};
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+/**
+ * Time "body(n)" (which performs n repetitions of "ops_per_rep" operations),
+ * and print one CSV line.
+ */
+template <typename F>
+void measure( const string& name, uint64_t param, uint64_t ops_per_rep, F body )
+{
+    if ( !filter.empty() && name.find(filter) == string::npos ) return;
+
+    typedef chrono::steady_clock clock;
+    auto elapsed = [&]( uint64_t n ) {
+        auto t0 = clock::now(); body(n);
+        return chrono::duration<double,nano>( clock::now() - t0 ).count();
+    };
+
+    // Calibrate the number of repetitions
+    uint64_t n = 1;
+    while ( elapsed(n) < min_ms * 1e6 && n < (1ull << 40) ) n *= 2;
+
+    vector<double> ns;
+    for ( unsigned r = 0; r < reps; ++r ) ns.push_back( elapsed(n) / (n * ops_per_rep) );
+    sort( ns.begin(), ns.end() );
+
+    cout << name << ',' << param << ',' << n * ops_per_rep << ',' << ns.front() << ','
+         << ns[ns.size()/2] << ',' << 1e3 / ns[ns.size()/2] << endl;
+}
+
+/**
+ * Baseline: direct calls through an array of function pointers.
+ */
+void bench_direct( unsigned subscribers )
+{
+    typedef void (*fptr)( const int& );
+    vector<fptr> targets( subscribers, &plain_callback<int> );
+    int data = 0;
+
+    measure( "direct_call", subscribers, subscribers, [&]( uint64_t n ) {
+        for ( uint64_t i = 0; i < n; ++i )
+            for ( auto f: targets ) (*f)(data);
+    });
+}
+
+template <typename T>
+void bench_invoke_slot( const string& name, unsigned subscribers, typename Slot<T>::callback_type cb )
+{
+    Signal<T> signal;
+    unique_ptr< Slot<T>[] > slots( new Slot<T>[subscribers] );
+    for ( unsigned i = 0; i < subscribers; ++i )
+    {
+        slots[i].bind( cb );
+        slots[i].subscribe( &signal );
+    }
+
+    measure( name, subscribers, subscribers, [&]( uint64_t n ) {
+        for ( uint64_t i = 0; i < n; ++i ) signal.invoke();
+    });
+}
+
+template <typename T>
+void bench_invoke_member( const string& name, unsigned subscribers )
+{
+    Signal<T> signal;
+    unique_ptr< Receiver<T>[] > receivers( new Receiver<T>[subscribers] );
+    for ( unsigned i = 0; i < subscribers; ++i )
+    {
+        receivers[i].slot.bind( &receivers[i], &Receiver<T>::callback );
+        receivers[i].slot.subscribe( &signal );
+    }
+
+    measure( name, subscribers, subscribers, [&]( uint64_t n ) {
+        for ( uint64_t i = 0; i < n; ++i ) signal.invoke();
+    });
+}
+
+/**
+ * Payload effects: write the event data, then invoke.
+ */
+template <unsigned N>
+void bench_payload( unsigned subscribers )
+{
+    typedef Payload<N> T;
+    Signal<T> signal;
+    unique_ptr< Slot<T>[] > slots( new Slot<T>[subscribers] );
+    for ( unsigned i = 0; i < subscribers; ++i )
+    {
+        slots[i].bind( &plain_callback<T> );
+        slots[i].subscribe( &signal );
+    }
+
+    T event = {};
+    measure( "payload_copy_invoke", N, subscribers, [&]( uint64_t n ) {
+        for ( uint64_t i = 0; i < n; ++i )
+        {
+            event.bytes[0] = char(i);
+            signal.data = event;
+            signal.invoke();
+        }
+    });
+}
+
+/**
+ * Churn: one Slot subscribing and unsubscribing from a Signal which already
+ * has "subscribers" other Slots.
+ */
+void bench_churn( unsigned subscribers )
+{
+    Signal<int> signal;
+    unique_ptr< Slot<int>[] > slots( new Slot<int>[subscribers] );
+    for ( unsigned i = 0; i < subscribers; ++i )
+    {
+        slots[i].bind( &plain_callback<int> );
+        slots[i].subscribe( &signal );
+    }
+
+    Slot<int> churner( &plain_callback<int> );
+    measure( "subscribe_unsubscribe", subscribers, 1, [&]( uint64_t n ) {
+        for ( uint64_t i = 0; i < n; ++i )
+        {
+            churner.subscribe( &signal );
+            churner.unsubscribe();
+        }
+    });
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+int main( int argc, char *argv[] )
+{
+    if ( argc > 1 ) min_ms = atoi(argv[1]);
+    if ( argc > 2 ) reps   = max( 1, atoi(argv[2]) );
+    if ( argc > 3 ) filter = argv[3];
+
+    cout << "benchmark,param,ops,min_ns_per_op,median_ns_per_op,mops_per_sec" << endl;
+
+    const unsigned counts[] = { 1, 10, 100, 1000, 10000, 100000 };
+    for ( unsigned n: counts ) bench_direct(n);
+    for ( unsigned n: counts ) bench_invoke_slot<int>( "invoke_slot", n, &plain_callback<int> );
+    for ( unsigned n: counts ) bench_invoke_member<int>( "invoke_member_slot", n );
+    for ( unsigned n: counts ) bench_invoke_slot<VoidData>( "invoke_void_slot", n, &void_callback );
+    for ( unsigned n: counts ) bench_churn(n);
+
+    bench_payload<8>(10);
+    bench_payload<64>(10);
+    bench_payload<512>(10);
+    bench_payload<4096>(10);
+    bench_payload<65536>(10);
+}
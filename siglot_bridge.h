@@ -0,0 +1,521 @@
+#ifndef __SIGLOT_BRIDGE__
+#define __SIGLOT_BRIDGE__
+
+#include "siglot.h"
+#include "siglot_alloc.h"
+
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cerrno>
+#include <functional>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+//=============================================
+// @filename     siglot_bridge.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Wire format shared by the bridge endpoints.
+ * Each frame is a fixed header followed by "count" contiguous payloads:
+ *
+ *     [ uint32 count ][ data_type ]...[ data_type ]
+ *
+ * Payloads are copied bytewise, so data_type must be trivially copyable
+ * and both processes must agree on its layout (same build, same ABI).
+ */
+struct BridgeHeader
+{
+	uint32_t count;
+};
+
+/**
+ * Create a connected pair of Unix stream sockets, eg to test a bridge
+ * within a single process, or to share with a child after fork().
+ * Any other connected stream socket (Unix domain or loopback TCP) works too.
+ */
+inline bool bridge_socketpair( int fds[2] )
+{
+	return ::socketpair( AF_UNIX, SOCK_STREAM, 0, fds ) == 0;
+}
+
+
+
+/**
+ * Topic key of a name (64 bits FNV-1a), eg to name Signals or channels in an
+ * InterestMap consistently across processes.
+ */
+inline uint64_t interest_topic( const std::string& name )
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for ( unsigned char c: name ) { h ^= c; h *= 0x100000001b3ull; }
+	return h;
+}
+
+/**
+ * Interest of remote listeners, published back to producers.
+ *
+ * A counting Bloom filter over 64 bits topic keys, in memory shared by the
+ * processes of a bridge: receivers add() the topics they listen to, and
+ * remove() them when they stop; producers test wanted() before serializing
+ * an event, with two relaxed loads and no system call. The total number of
+ * interests is kept separately, so that an idle map is detected with a
+ * single load.
+ *
+ * Answers may be false positives (an event is sent that nobody reads, which
+ * the receiver ignores as before), never false negatives. Interests left by
+ * a crashed receiver only cause false positives as well.
+ *
+ * - open( name, cells ): create or attach to a named segment (shm_open);
+ *                        fails if it exists with another number of cells
+ * - create( cells )    : anonymous shared map, inherited by fork()
+ * - unlink( name )     : remove a named segment (attached maps stay valid)
+ *
+ * All processes must use the same number of cells; open() fails otherwise.
+ */
+class InterestMap
+{
+public:
+
+	InterestMap(): header(nullptr), counters(nullptr), bytes(0) {}
+	~InterestMap() { close(); }
+
+	InterestMap( const InterestMap& other ) = delete;
+	InterestMap& operator= ( const InterestMap& other ) = delete;
+
+	bool open( const std::string& name, uint32_t cells = 4096 )
+	{
+		close();
+		cells = _cells(cells);
+		const size_t n = sizeof(Header) + cells * sizeof(std::atomic<uint32_t>);
+
+		// Only the process creating the segment sizes it; the others wait
+		// for it to be sized, and must agree with its size
+		int fd = ::shm_open( name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644 );
+		if ( fd >= 0 )
+		{
+			if ( ::ftruncate( fd, n ) != 0 ) { ::close(fd); ::shm_unlink( name.c_str() ); return false; }
+		}
+		else
+		{
+			if ( errno != EEXIST ) return false;
+			fd = ::shm_open( name.c_str(), O_RDWR, 0 );
+			if ( fd < 0 ) return false;
+
+			struct stat st;
+			for ( unsigned k = 0; ::fstat( fd, &st ) == 0 && st.st_size == 0 && k < 10000; ++k ) ::usleep(100);
+			if ( ::fstat( fd, &st ) != 0 || size_t(st.st_size) != n ) { ::close(fd); return false; }
+		}
+
+		void *p = ::mmap( nullptr, n, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 );
+		::close(fd);
+		return p != MAP_FAILED && _attach( p, n, cells );
+	}
+
+	bool create( uint32_t cells = 4096 )
+	{
+		close();
+		cells = _cells(cells);
+		const size_t n = sizeof(Header) + cells * sizeof(std::atomic<uint32_t>);
+		void *p = ::mmap( nullptr, n, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0 );
+		return p != MAP_FAILED && _attach( p, n, cells );
+	}
+
+	inline static bool unlink( const std::string& name ) { return ::shm_unlink( name.c_str() ) == 0; }
+
+	void close()
+	{
+		if ( header ) ::munmap( header, bytes );
+		header = nullptr; counters = nullptr;
+	}
+
+	inline bool is_open() const { return header; }
+	inline uint32_t cells() const { return header ? header->cells.load(std::memory_order_relaxed) : 0; }
+
+	// Number of interests currently registered, in all processes
+	inline uint64_t total() const { return header ? header->total.load(std::memory_order_relaxed) : 0; }
+
+	void add( uint64_t topic )
+	{
+		if ( !header ) return;
+		const uint32_t m = cells() - 1;
+		counters[ _h1(topic) & m ].fetch_add( 1, std::memory_order_relaxed );
+		counters[ _h2(topic) & m ].fetch_add( 1, std::memory_order_relaxed );
+		header->total.fetch_add( 1, std::memory_order_release );
+	}
+
+	// Returns false (and changes nothing) if no interest is registered
+	bool remove( uint64_t topic )
+	{
+		if ( !header || !_decrement( header->total ) ) return false;
+
+		// Counters never go below zero, even if removes are unbalanced
+		const uint32_t m = cells() - 1;
+		_decrement( counters[ _h1(topic) & m ] );
+		_decrement( counters[ _h2(topic) & m ] );
+		return true;
+	}
+
+	// True if a remote listener may be interested in the topic
+	// (always true when the map is not open, so that nothing is lost)
+	inline bool wanted( uint64_t topic ) const
+	{
+		if ( !header ) return true;
+		if ( header->total.load(std::memory_order_relaxed) == 0 ) return false;
+
+		const uint32_t m = cells() - 1;
+		return counters[ _h1(topic) & m ].load(std::memory_order_relaxed)
+			&& counters[ _h2(topic) & m ].load(std::memory_order_relaxed);
+	}
+
+	// True if any remote listener is registered
+	inline bool any() const { return !header || total(); }
+
+protected:
+
+	// The zero-filled segment is a valid empty map
+	struct Header
+	{
+		std::atomic<uint32_t> cells;
+		uint32_t reserved;
+		std::atomic<uint64_t> total;
+	};
+
+	static_assert( ATOMIC_INT_LOCK_FREE == 2 && ATOMIC_LLONG_LOCK_FREE == 2,
+		"Shared interest maps require lock-free atomics." );
+
+	// Power of two, for masking
+	inline static uint32_t _cells( uint32_t n )
+	{
+		uint32_t c = 64;
+		while ( c < n && c < (1u << 30) ) c <<= 1;
+		return c;
+	}
+
+	template <typename T>
+	inline static bool _decrement( std::atomic<T>& c )
+	{
+		T v = c.load(std::memory_order_relaxed);
+		while ( v && !c.compare_exchange_weak( v, v - 1, std::memory_order_release, std::memory_order_relaxed ) );
+		return v;
+	}
+
+	inline static uint32_t _h1( uint64_t t ) { return (t * 0x9E3779B97F4A7C15ull) >> 32; }
+	inline static uint32_t _h2( uint64_t t ) { return (t * 0xC2B2AE3D27D4EB4Full) >> 32; }
+
+	bool _attach( void *p, size_t n, uint32_t c )
+	{
+		header   = static_cast<Header*>(p);
+		counters = reinterpret_cast<std::atomic<uint32_t>*>( header + 1 );
+		bytes    = n;
+
+		// The first process sets the size, the others must agree with it
+		uint32_t expected = 0;
+		if ( !header->cells.compare_exchange_strong( expected, c ) && expected != c )
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	Header *header;
+	std::atomic<uint32_t> *counters;
+	size_t bytes;
+};
+
+/**
+ * Interest in one topic for the lifetime of the object.
+ */
+class Interest
+{
+public:
+
+	Interest( InterestMap& m, uint64_t topic ): map(&m), topic(topic) { map->add(topic); }
+	~Interest() { map->remove(topic); }
+
+	Interest( const Interest& other ) = delete;
+	Interest& operator= ( const Interest& other ) = delete;
+
+protected:
+
+	InterestMap *map;
+	uint64_t topic;
+};
+
+
+
+/**
+ * Sending end of a bridge.
+ * Subscribes to a local Signal like any other Slot, and appends a copy of
+ * each event to a preallocated batch. A batch is written with a single
+ * sendmsg call once it is full, or when flush is called explicitly.
+ * MSG_NOSIGNAL is set, so a closed peer is reported by error() instead of
+ * raising SIGPIPE. Once a write has failed, events are counted as dropped
+ * instead of being queued, so the batch stays bounded.
+ *
+ * With an InterestMap, events that no remote listener wants are dropped
+ * before they are copied: either all events of a topic, or each event by
+ * the topic of its key.
+ *
+ * NOTE:
+ * The writer does not own the file descriptor.
+ */
+template <typename data_type>
+class SignalWriter
+	: public ListenerInterface<data_type>
+{
+public:
+
+	typedef SignalWriter<data_type> self;
+	typedef std::function<uint64_t( const data_type& )> key_type;
+
+	static_assert( std::is_trivially_copyable<data_type>::value,
+		"Bridged data types must be trivially copyable." );
+
+	SignalWriter( int fd, unsigned batch_size = 64 )
+		: fd(fd), batch_size(batch_size ? batch_size : 1), failed(false),
+		  interests(nullptr), topic(0), skips(0), drops(0)
+	{ batch.reserve( this->batch_size ); }
+	~SignalWriter() { flush(); this->unsubscribe(); }
+
+	// Writers are bound to a descriptor and cannot be copied
+	SignalWriter( const self& other ) = delete;
+	self& operator= ( const self& other ) = delete;
+
+	// Number of events waiting to be sent
+	inline unsigned pending() const { return batch.size(); }
+
+	// True if a previous write failed (eg the peer closed the connection)
+	inline bool error() const { return failed; }
+
+	// Only send the events of a topic while a remote listener wants it
+	void interest( const InterestMap *m, uint64_t t )
+	{
+		interests = m; topic = t; key = nullptr;
+	}
+
+	// Only send the events whose key topic a remote listener wants
+	void interest( const InterestMap *m, key_type k )
+	{
+		interests = m; topic = 0; key = k;
+	}
+
+	// Number of events dropped for lack of interest
+	inline uint64_t skipped() const { return skips; }
+
+	// Number of events dropped after a failed write
+	inline uint64_t dropped() const { return drops; }
+
+	// Send all pending events in one frame
+	bool flush()
+	{
+		if ( batch.empty() || failed ) return !failed;
+
+		BridgeHeader header;
+		header.count = batch.size();
+
+		struct iovec iov[2];
+		iov[0].iov_base = &header;
+		iov[0].iov_len  = sizeof(BridgeHeader);
+		iov[1].iov_base = batch.data();
+		iov[1].iov_len  = batch.size() * sizeof(data_type);
+
+		failed = !_send_all( iov, 2 );
+		batch.clear();
+		return !failed;
+	}
+
+protected:
+
+	inline void operator() ( const data_type& data )
+	{
+		if ( failed )
+		{
+			++drops;
+			SIGLOT_PROBE( queue, this->signal, 0, 1 );
+			return;
+		}
+		if ( interests && !interests->wanted( key ? key(data) : topic ) ) { ++skips; return; }
+
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_queue );
+			batch.push_back(data);
+		}
+		if ( batch.size() >= batch_size ) flush();
+		SIGLOT_PROBE( queue, this->signal, batch.size(), 0 );
+	}
+
+	// Send the whole vector, resuming after partial writes and interrupts
+	bool _send_all( struct iovec *iov, int n )
+	{
+		struct msghdr msg = {};
+		while ( n > 0 )
+		{
+			msg.msg_iov    = iov;
+			msg.msg_iovlen = n;
+
+			ssize_t w = ::sendmsg( fd, &msg, MSG_NOSIGNAL );
+			if ( w < 0 )
+			{
+				if ( errno == EINTR ) continue;
+				return false;
+			}
+
+			size_t r = w;
+			while ( n > 0 && r >= iov->iov_len ) { r -= iov->iov_len; ++iov; --n; }
+			if ( n > 0 )
+			{
+				iov->iov_base = static_cast<char*>(iov->iov_base) + r;
+				iov->iov_len -= r;
+			}
+		}
+		return true;
+	}
+
+	int fd;
+	unsigned batch_size;
+	bool failed;
+	std::vector<data_type> batch;
+
+	const InterestMap *interests;
+	uint64_t topic;
+	key_type key;
+	uint64_t skips;
+	uint64_t drops;
+};
+
+
+
+/**
+ * Receiving end of a bridge.
+ * Decodes incoming frames into a reusable buffer, and replays each event
+ * through the mirror Signal, which local Slots subscribe to as usual.
+ * The buffer only grows to the largest frame received, so steady-state
+ * reception does not allocate. Frames of more than "max_batch" events are
+ * rejected as corrupted (receive returns false and error() is set), so the
+ * peer cannot make the reader allocate without bound: max_batch must be at
+ * least the batch size of the writer.
+ *
+ * A reader may advertise a topic in an InterestMap while its mirror has
+ * subscribers. Subscriptions are checked on each frame received, but frames
+ * may stop for good: producers send nothing while the topic is not wanted,
+ * and keep sending while it is. Call refresh() after subscribing to the
+ * mirror, and after unsubscribing from it, so that the advertisement
+ * follows the subscribers.
+ *
+ * NOTE:
+ * The reader does not own the file descriptor.
+ */
+template <typename data_type>
+class SignalReader
+{
+public:
+
+	typedef SignalReader<data_type> self;
+
+	static_assert( std::is_trivially_copyable<data_type>::value,
+		"Bridged data types must be trivially copyable." );
+
+	Signal<data_type> mirror;
+
+	SignalReader( int fd, unsigned max_batch = 4096 )
+		: fd(fd), max_batch(max_batch ? max_batch : 1), failed(false),
+		  interests(nullptr), topic(0), advertised(false) {}
+	~SignalReader() { advertise( nullptr, 0 ); }
+
+	SignalReader( const self& other ) = delete;
+	self& operator= ( const self& other ) = delete;
+
+	// Publish interest in a topic while the mirror has subscribers
+	// (a null map withdraws it)
+	void advertise( InterestMap *m, uint64_t t )
+	{
+		if ( advertised ) interests->remove(topic);
+		interests = m; topic = t; advertised = false;
+		refresh();
+	}
+
+	// Update the advertised interest; call it after each subscription to the
+	// mirror or unsubscription from it (receive only checks on each frame)
+	void refresh()
+	{
+		const bool want = interests && mirror.count() > 0;
+		if ( want == advertised ) return;
+
+		if ( want ) interests->add(topic);
+		else interests->remove(topic);
+		advertised = want;
+	}
+
+	// True if a frame was larger than max_batch
+	inline bool error() const { return failed; }
+
+	// Block until one frame is received, and invoke the mirror for each event.
+	// Returns false on end-of-stream or error.
+	bool receive()
+	{
+		BridgeHeader header;
+		if ( failed || !_read_all( &header, sizeof(BridgeHeader) ) ) return false;
+		if ( header.count > max_batch ) return !(failed = true);
+		refresh();
+
+		if ( header.count > pool.size() )
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_copy );
+			pool.resize( header.count );
+		}
+		if ( !_read_all( pool.data(), header.count * sizeof(data_type) ) ) return false;
+
+		for ( uint32_t i = 0; i < header.count; ++i )
+		{
+			mirror.data = pool[i];
+			mirror.invoke();
+		}
+		return true;
+	}
+
+	// Receive frames until end-of-stream or error
+	void run() { while ( receive() ); }
+
+protected:
+
+	bool _read_all( void *buf, size_t len )
+	{
+		char *p = static_cast<char*>(buf);
+		while ( len > 0 )
+		{
+			ssize_t r = ::read( fd, p, len );
+			if ( r < 0 && errno == EINTR ) continue;
+			if ( r <= 0 ) return false;
+			p += r; len -= r;
+		}
+		return true;
+	}
+
+	int fd;
+	unsigned max_batch;
+	bool failed;
+	std::vector<data_type> pool;
+
+	InterestMap *interests;
+	uint64_t topic;
+	bool advertised;
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#!/bin/sh
+#=============================================
+# Build benchmark: compile time and code size against the number of event
+# types. For each count N, a translation unit declaring N distinct data types
+# (each with a Signal, a Slot and a MemberSlot, subscribed and invoked) is
+# generated and compiled with optimizations; the output is CSV on stdout:
+#
+#     types,compile_s,text_bytes
+#
+# Usage: siglot_buildbench.sh [include_dir=.] [counts="1 10 50 100 200"]
+#
+# Pass the directory of another version of siglot.h as include_dir to
+# compare versions.
+#=============================================
+
+INCLUDE=${1:-.}
+COUNTS=${2:-"1 10 50 100 200"}
+CXX=${CXX:-g++}
+TMP=$(mktemp -d)
+trap 'rm -rf "$TMP"' EXIT
+
+echo "types,compile_s,text_bytes"
+for N in $COUNTS; do
+    SRC="$TMP/types_$N.cpp"
+    {
+        echo '#include "siglot.h"'
+        echo 'using namespace siglot;'
+        echo 'volatile int sink;'
+        i=0
+        while [ $i -lt $N ]; do
+            cat <<EOF
+struct Event$i { int value; };
+void plain$i( const Event$i& e ) { sink = e.value; }
+struct Handler$i {
+    MemberSlot<Handler$i,Event$i> slot;
+    Handler$i(): slot( this, &Handler$i::member ) {}
+    void member( const Event$i& e ) { sink = e.value; }
+};
+void run$i() {
+    Signal<Event$i> signal; Slot<Event$i> slot( plain$i ); Handler$i handler;
+    slot.subscribe( &signal ); handler.slot.subscribe( &signal );
+    signal.data.value = $i; signal.invoke();
+    slot.unsubscribe(); signal.clear();
+}
+EOF
+            i=$((i+1))
+        done
+        echo 'int main() {'
+        i=0
+        while [ $i -lt $N ]; do echo "    run$i();"; i=$((i+1)); done
+        echo '}'
+    } > "$SRC"
+
+    START=$(date +%s.%N)
+    $CXX -std=c++0x -O2 -I"$INCLUDE" -c "$SRC" -o "$TMP/types_$N.o" || exit 1
+    END=$(date +%s.%N)
+
+    TEXT=$(size -A "$TMP/types_$N.o" | awk '$1 ~ /^\.text/ { t += $2 } END { print t }')
+    echo "$N,$(awk "BEGIN { print $END - $START }"),$TEXT"
+done
@@ -0,0 +1,1262 @@
+// Count heap allocations (see check_alloc)
+#define SIGLOT_ALLOC_HOOKS
+
+#include "siglot.h"
+#include "siglot_alloc.h"
+#include "siglot_thread.h"
+#include "siglot_stats.h"
+#include "siglot_trace.h"
+#include "siglot_graph.h"
+#include "siglot_tree.h"
+#include "siglot_rt.h"
+#include "siglot_spatial.h"
+#include "siglot_wiring.h"
+#include "siglot_bridge.h"
+#include "siglot_shm.h"
+#include "siglot_watchdog.h"
+#include "siglot_journal.h"
+#include "siglot_pmu.h"
+#include <thread>
+#include <string>
+#include <vector>
+#include <utility>
+#include <cstdlib>
+#include <sstream>
+#include <iostream>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+using namespace std;
+using namespace siglot;
+
+//=============================================
+// Behaviour checks of the library and its optional headers.
+// Each check prints its name and result; the exit status is the number of
+// failures.
+//
+// Usage: siglot_check [filter]
+//=============================================
+
+
+
+string filter;
+unsigned failures = 0;
+
+bool selected( const string& name ) { return filter.empty() || name.find(filter) != string::npos; }
+
+void check( const string& name, bool ok )
+{
+    cout << ( ok ? "ok   " : "FAIL " ) << name << endl;
+    if ( !ok ) ++failures;
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+/**
+ * Slots which count their calls, and may unsubscribe themselves, another Slot,
+ * or subscribe another Slot from their callback.
+ */
+struct Counter
+{
+    MemberSlot<Counter,int> slot;
+    unsigned calls;
+    bool once;
+    Counter *other_off, *other_on;
+    Signal<int> *signal;
+
+    Counter(): calls(0), once(false), other_off(nullptr), other_on(nullptr), signal(nullptr)
+        { slot.bind( this, &Counter::call ); }
+
+    void call( const int& )
+    {
+        ++calls;
+        if ( once ) slot.unsubscribe();
+        if ( other_off ) other_off->slot.unsubscribe();
+        if ( other_on ) other_on->slot.subscribe( signal );
+    }
+};
+
+// Subscribe n counters, and bring the storage to a given form
+void make_form( Signal<int>& signal, vector<Counter>& counters, SlotStorage::Form form )
+{
+    for ( auto& c: counters ) { c.signal = &signal; c.slot.subscribe( &signal ); }
+
+    // Churn with a spare Slot until the storage converts to the indexed form
+    Counter spare;
+    for ( unsigned i = 0; form == SlotStorage::indexed && signal.storage() != form && i < 100000; ++i )
+    {
+        spare.slot.subscribe( &signal );
+        spare.slot.unsubscribe();
+    }
+}
+
+Signal<int> *clear_target = nullptr;
+void clear_signal( const int& ) { clear_target->clear(); }
+
+void check_storage()
+{
+    const SlotStorage::Form forms[] = { SlotStorage::small, SlotStorage::flat, SlotStorage::indexed };
+    const unsigned sizes[] = { 3, 10, 2000 };
+    const char *names[] = { "small", "flat", "indexed" };
+
+    for ( unsigned f = 0; f < 3; ++f )
+    {
+        const string prefix = string("storage_") + names[f];
+        if ( !selected(prefix) ) continue;
+
+        // Every Slot unsubscribes itself: all are called once
+        {
+            Signal<int> signal;
+            vector<Counter> c( sizes[f] );
+            make_form( signal, c, forms[f] );
+            check( prefix + "_form", signal.storage() == forms[f] );
+
+            for ( auto& x: c ) x.once = true;
+            signal.invoke();
+            unsigned called = 0;
+            for ( auto& x: c ) called += x.calls == 1;
+            check( prefix + "_self_unsubscribe", called == c.size() && signal.count() == 0 );
+        }
+
+        // A Slot unsubscribes the next one, which is not called; a Slot
+        // subscribed during an emission is only called from the next one
+        {
+            Signal<int> signal;
+            vector<Counter> c( sizes[f] );
+            Counter late;
+            late.signal = &signal;
+            make_form( signal, c, forms[f] );
+
+            c[0].other_off = &c[1];
+            c[0].other_on  = &late;
+            signal.invoke();
+
+            unsigned called = 0;
+            for ( auto& x: c ) called += x.calls;
+            bool ok = c[1].calls == 0 && late.calls == 0 && called + 1 == c.size()
+                && signal.count() == c.size() && late.slot.is_active() && !c[1].slot.is_active();
+
+            c[0].other_off = c[0].other_on = nullptr;
+            signal.invoke();
+            check( prefix + "_deferred", ok && late.calls == 1 && signal.count() == c.size() );
+        }
+    }
+
+    if ( selected("storage_clear") )
+    {
+        Signal<int> signal;
+        vector<Counter> c( 10 );
+        make_form( signal, c, SlotStorage::flat );
+
+        clear_target = &signal;
+        Slot<int> clearer( &clear_signal );
+        clearer.subscribe( &signal );
+        signal.invoke();
+
+        bool inactive = true;
+        for ( auto& x: c ) inactive = inactive && !x.slot.is_active();
+        check( "storage_clear_during_invoke", signal.count() == 0 && inactive );
+    }
+
+    // A Signal built by churn, then only invoked, returns to the flat form:
+    // during emissions when adaptive, otherwise at the next change
+    if ( selected("storage_invoked") )
+    {
+        Signal<int> adaptive, plain;
+        vector<Counter> a( 2000 ), p( 2000 );
+        make_form( adaptive, a, SlotStorage::indexed );
+        make_form( plain, p, SlotStorage::indexed );
+        bool built = adaptive.storage() == SlotStorage::indexed && plain.storage() == SlotStorage::indexed;
+
+        adaptive.adaptive( true );
+        for ( unsigned i = 0; i < 2*SlotStorage::window; ++i ) { adaptive.invoke(); plain.invoke(); }
+        bool waits = plain.storage() == SlotStorage::indexed;
+
+        Counter late;
+        late.slot.subscribe( &plain );
+        check( "storage_invoked_flat", built && waits &&
+            adaptive.storage() == SlotStorage::flat && plain.storage() == SlotStorage::flat );
+    }
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+/**
+ * Entities of a SpatialSignal, which move themselves or others when they
+ * receive an event.
+ */
+struct Entity
+{
+    MemberSlot<Entity,int> slot;
+    SpatialSignal<int> *space;
+    vector<Entity*> push;  // entities moved away on each event
+    unsigned calls;
+    bool leave;
+
+    Entity(): space(nullptr), calls(0), leave(false) { slot.bind( this, &Entity::call ); }
+
+    void call( const int& )
+    {
+        ++calls;
+        for ( auto e: push ) space->move( e->slot, Region{ 50, 50, 51, 51 } );
+        if ( leave ) space->unsubscribe( slot );
+    }
+};
+
+void check_spatial()
+{
+    if ( !selected("spatial") ) return;
+
+    SpatialSignal<int> space( 1.0 );
+    vector<Entity> e( 8 );
+    for ( auto& x: e )
+    {
+        x.space = &space;
+        space.subscribe( x.slot, Region{ 0, 0, 1, 1 } );
+    }
+
+    // The first entity called moves two others out of the emitting cell,
+    // and unsubscribes itself; those which moved are no longer interested
+    for ( auto& x: e ) { x.push = { &e[2], &e[5] }; x.leave = true; }
+    space.invoke( 0.5, 0.5 );
+
+    unsigned called = 0;
+    for ( auto& x: e ) called += x.calls;
+    check( "spatial_move_in_callback", called == 6 && e[2].calls == 0 && e[5].calls == 0
+        && space.count() == 2 && space.regions() == 2 );
+
+    // The moved entities receive events at their new position
+    for ( auto& x: e ) { x.push.clear(); x.leave = false; x.calls = 0; }
+    space.invoke( 50.5, 50.5 );
+    check( "spatial_moved_receive", e[2].calls == 1 && e[5].calls == 1 && e[0].calls == 0 );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+/**
+ * Probe counting subscription changes.
+ */
+struct SubscriptionProbe
+    : public Probe
+{
+    unsigned subscribes, unsubscribes;
+    SubscriptionProbe(): subscribes(0), unsubscribes(0) {}
+
+    void subscribe( const void*, const void* ) { ++subscribes; }
+    void unsubscribe( const void*, const void* ) { ++unsubscribes; }
+};
+
+// Can a Slot of type S be connected through a handle of type H?
+template <typename H, typename S>
+auto wiring_accepts( int ) -> decltype( declval<Wiring&>().connect( declval<H>(), declval<S&>() ), bool() )
+    { return true; }
+template <typename H, typename S>
+bool wiring_accepts( ... ) { return false; }
+
+void check_wiring()
+{
+    if ( !selected("wiring") ) return;
+
+    check( "wiring_typed_handle",
+        wiring_accepts< Wiring::Handle<int>, Slot<int> >(0) &&
+        !wiring_accepts< Wiring::Handle<int>, Slot<string> >(0) &&
+        !wiring_accepts< Signal<int>*, Slot<string> >(0) );
+
+    Signal<int> a, b, c;
+    vector<Counter> slots( 10 );
+    for ( unsigned i = 0; i < 5; ++i ) slots[i].slot.subscribe( &a );
+
+    SubscriptionProbe probe;
+    Probe::install( &probe );
+
+    // Slots 0-4 move from a to b or c, or stay on a; 5-9 are new; slot 8 is
+    // connected twice, and slot 9 twice to the same Signal
+    Wiring w;
+    Wiring::Handle<int> hb = w.signal( &b ), hc = w.signal( &c );
+    w.connect( hb, slots[0].slot );
+    w.connect( hc, slots[0].slot );
+    w.connect( hb, slots[1].slot );
+    w.connect( &a, slots[2].slot );
+    for ( unsigned i = 5; i < 10; ++i ) w.connect( hb, slots[i].slot );
+    w.connect( hc, slots[8].slot );
+    w.connect( hb, slots[9].slot );
+    w.apply();
+
+    Probe::remove( &probe );
+
+    // Probes see 2 departures from a (slots 0 and 1), and one arrival per
+    // Slot joining a new Signal (0, 1 and 5-9)
+    check( "wiring_result", a.count() == 3 && b.count() == 5 && c.count() == 2 );
+    check( "wiring_probes", probe.unsubscribes == 2 && probe.subscribes == 7 );
+
+    a.invoke(); b.invoke(); c.invoke();
+    bool once = true;
+    for ( auto& x: slots ) once = once && x.calls == 1;
+    check( "wiring_delivery", once );
+
+    // Handles cannot be forged, and expire with their table
+    Wiring other;
+    Wiring::Handle<int> ha = w.signal( &a ), ho = other.signal( &a );
+    bool fresh = w.valid( ha ) && !w.valid( ho ) && !w.valid( Wiring::Handle<int>() );
+    w.apply();
+    check( "wiring_handle_table",
+        !std::is_constructible< Wiring::Handle<int>, unsigned >::value &&
+        fresh && !w.valid( ha ) && other.valid( ho ) );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_interest()
+{
+    if ( !selected("interest") ) return;
+
+    const string name = "/siglot_check_interest";
+    InterestMap::unlink( name );
+
+    InterestMap a, b, c;
+    bool opened = a.open( name, 256 ) && b.open( name, 256 );
+    check( "interest_shared", opened && ( a.add(42), b.wanted(42) ) && !b.wanted(43) );
+
+    // A process with another size is rejected, and does not resize the segment
+    bool rejected = !c.open( name, 1024 );
+    int fd = ::shm_open( name.c_str(), O_RDONLY, 0 );
+    struct stat st;
+    bool same = fd >= 0 && ::fstat( fd, &st ) == 0 && st.st_size == 8 + 8 + 256 * 4;
+    if ( fd >= 0 ) ::close(fd);
+    check( "interest_size_mismatch", rejected && same && b.wanted(42) );
+
+    // Unbalanced removes do not underflow
+    bool removed = b.remove(42) && !b.remove(42) && !b.remove(7);
+    check( "interest_remove", removed && a.total() == 0 && !a.wanted(42) && ( a.add(7), a.total() == 1 ) );
+
+    // A reader advertises its topic while its mirror has subscribers
+    InterestMap m;
+    bool advertised = false, withdrawn = false;
+    if ( m.create( 64 ) )
+    {
+        SignalReader<int> reader( -1 );
+        reader.advertise( &m, 5 );
+        Counter x;
+        x.slot.subscribe( &reader.mirror );
+        reader.refresh();
+        advertised = m.wanted(5);
+        x.slot.unsubscribe();
+        reader.refresh();
+        withdrawn = !m.wanted(5) && m.total() == 0;
+    }
+    check( "interest_reader_refresh", advertised && withdrawn );
+
+    InterestMap::unlink( name );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+// Relays each event of a Signal to another one
+Signal<int> *relay_target = nullptr;
+void relay( const int& ) { relay_target->invoke(); }
+
+void check_trace()
+{
+    if ( !selected("trace") ) return;
+
+    VirtualClock clock( 1500 );
+    ScopedClock scoped( clock );
+
+    Signal<int> outer, inner;
+    Slot<int> forward( &relay );
+    Counter c;
+    relay_target = &inner;
+    forward.subscribe( &outer );
+    c.slot.subscribe( &inner );
+
+    // Nested emissions are recorded as nested spans, labelled and escaped
+    {
+        TraceProbe probe( 64 );
+        probe.name( &outer, "ord\"ers" );
+        Probe::install( &probe );
+        outer.invoke();
+        Probe::remove( &probe );
+
+        // emit, slot, nested emit, nested slot, then their ends
+        const bool slots[] = { false, true, false, true, true, false, true, false };
+        auto events = probe.events();
+        bool nested = events.size() == 1 && events[0].size() == 8;
+        for ( unsigned k = 0; nested && k < 8; ++k )
+            nested = events[0][k].begin == ( k < 4 ) && ( events[0][k].slot != nullptr ) == slots[k];
+
+        std::ostringstream os;
+        probe.export_json( os );
+        const string json = os.str();
+        check( "trace_nested", nested && c.calls == 1 &&
+            json.find( "\"name\":\"ord\\\"ers\"" ) != string::npos &&
+            json.find( "\"ts\":1.500" ) != string::npos );
+    }
+
+    // Ends whose beginning was overwritten are left out
+    {
+        TraceProbe probe( 3 );
+        Probe::install( &probe );
+        outer.invoke();
+        Probe::remove( &probe );
+
+        std::ostringstream os;
+        probe.export_json( os );
+        check( "trace_overwritten", os.str().find( "\"ph\":\"E\"" ) == string::npos );
+    }
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_graph()
+{
+    if ( !selected("graph") ) return;
+
+    // Subscriptions and forwards (a Slot emitting another Signal) are
+    // tracked live, and destroyed nodes leave the graph
+    GraphProbe probe;
+    Probe::install( &probe );
+    Slot<int> forward( &relay );
+    Counter c;
+    bool live, forwarded;
+    {
+        Signal<int> outer, inner;
+        relay_target = &inner;
+        forward.subscribe( &outer );
+        c.slot.subscribe( &inner );
+        probe.name( &outer, "outer" );
+        outer.invoke();
+
+        SignalGraph g = probe.graph();
+        live = g.signals.count( &outer ) && g.signals.count( &inner ) &&
+            g.subscriptions.count( SignalGraph::edge_type( &outer, &forward ) ) &&
+            g.subscriptions.count( SignalGraph::edge_type( &inner, &c.slot ) );
+
+        std::ostringstream os;
+        g.export_dot( os );
+        forwarded = g.stats.forwards[ SignalGraph::edge_type( &forward, &inner ) ] == 1 &&
+            os.str().find( "label=\"outer\\nemits 1\"" ) != string::npos &&
+            os.str().find( "style=dashed" ) != string::npos;
+    }
+    SignalGraph g = probe.graph();
+    bool gone = g.signals.empty() && g.subscriptions.empty() && g.stats.forwards.empty();
+    Probe::remove( &probe );
+
+    check( "graph_live", live && forwarded && gone && c.calls == 1 );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+// Record of a Signal in a statistics segment (nullptr if not found)
+const ShmRecord* shm_record( ShmView& view, const void *signal )
+{
+    for ( unsigned i = 0; i < view.capacity(); ++i )
+        if ( view.record(i).key.load() == reinterpret_cast<uintptr_t>(signal) ) return &view.record(i);
+    return nullptr;
+}
+
+void check_shm()
+{
+    if ( !selected("shm") ) return;
+
+    Signal<int> signal;
+    ShmStatsProbe probe( "/siglot_check_shm", 16 );
+    probe.name( &signal, "orders" );
+    probe.emit_begin( &signal, 3 );
+
+    ShmView view;
+    bool open = probe.is_open() && view.open( "/siglot_check_shm" );
+
+    bool aligned = open, found = false;
+    for ( unsigned i = 0; open && i < view.capacity(); ++i )
+    {
+        aligned = aligned && reinterpret_cast<uintptr_t>( &view.record(i) ) % 64 == 0;
+        if ( view.record(i).key.load() == reinterpret_cast<uintptr_t>(&signal) )
+            found = view.name(i) == "orders" && view.record(i).emits.load() == 1;
+    }
+    check( "shm_layout", aligned && found );
+
+    // Queued Signals publish their depth, and bridge writers their drops
+    Probe::install( &probe );
+    {
+        Sequencer sequencer;
+        SequencedSignal<int> sequenced( sequencer );
+        Counter c;
+        c.slot.subscribe( &sequenced );
+        for ( int i = 0; i < 3; ++i ) sequenced.invoke( i );
+        const ShmRecord *r = open ? shm_record( view, &sequenced ) : nullptr;
+        bool queued = r && r->queue_depth.load() == 3;
+        sequencer.poll();
+        check( "shm_queue_depth", queued && r->queue_depth.load() == 0 && c.calls == 3 );
+
+        int fds[2];
+        bool paired = bridge_socketpair( fds );
+        if ( paired ) ::close( fds[1] );
+        {
+            SignalWriter<int> writer( paired ? fds[0] : -1, 1 );
+            writer.subscribe( &signal );
+            for ( int i = 0; i < 5; ++i ) signal.invoke();
+            r = open ? shm_record( view, &signal ) : nullptr;
+            check( "shm_drops", paired && r && r->drops.load() == writer.dropped() && writer.dropped() == 4 );
+        }
+        if ( paired ) ::close( fds[0] );
+    }
+    Probe::remove( &probe );
+
+    // A segment shorter than its header announces is rejected
+    int fd = ::shm_open( "/siglot_check_shm", O_RDWR, 0 );
+    bool truncated = fd >= 0 && ::ftruncate( fd, sizeof(ShmHeader) + sizeof(ShmRecord) ) == 0;
+    if ( fd >= 0 ) ::close(fd);
+    ShmView short_view;
+    check( "shm_truncated", truncated && !short_view.open( "/siglot_check_shm" ) );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+// The callback moves the virtual clock past its budget, and has another thread
+// scan the probe while it is still running
+WatchdogProbe *watchdog = nullptr;
+VirtualClock *watchdog_clock = nullptr;
+void slow_callback( const int& )
+{
+    watchdog_clock->advance( 1000 );
+    std::thread monitor( []{ watchdog->check(); } );
+    monitor.join();
+}
+
+// Busy for about a microsecond, or not at all
+void spin_callback( const int& )
+{
+    const uint64_t start = clock_now();
+    while ( clock_now() - start < 1000 );
+}
+void quick_callback( const int& ) {}
+
+void check_watchdog()
+{
+    if ( !selected("watchdog") ) return;
+
+    // The handler invokes a watched Signal from the monitor thread, which
+    // registers that thread with the probe
+    {
+        Signal<int> work, alarm;
+        Counter alarmed;
+        alarmed.slot.subscribe( &alarm );
+
+        VirtualClock clock;
+        ScopedClock scoped( clock );
+        unsigned reports = 0;
+        WatchdogProbe probe( [&]( const WatchdogReport& ){ ++reports; alarm.invoke(); } );
+        probe.budget( std::chrono::nanoseconds(100) );
+        watchdog = &probe; watchdog_clock = &clock;
+
+        Slot<int> slow( &slow_callback );
+        slow.subscribe( &work );
+
+        Probe::install( &probe );
+        work.invoke();
+        Probe::remove( &probe );
+
+        check( "watchdog_handler_emits", reports == 1 && alarmed.calls == 1 && probe.overruns() == 1 );
+    }
+
+    // Callbacks of two Slots alternate while the monitor scans: each report
+    // matches the budget of its own Slot, and the fast Slot is never reported
+    {
+        Signal<int> work;
+        Slot<int> spin( &spin_callback ), quick( &quick_callback );
+        spin.subscribe( &work );
+        Signal<int> other;
+        quick.subscribe( &other );
+
+        unsigned mixed = 0;
+        WatchdogProbe probe( [&]( const WatchdogReport& r ){
+            if ( r.slot != &spin || r.budget != 1 ) ++mixed;
+        });
+        probe.budget( &spin, std::chrono::nanoseconds(1) );
+        probe.budget( &quick, std::chrono::hours(1) );
+
+        Probe::install( &probe );
+        std::atomic<bool> done( false );
+        std::thread emitter( [&]{
+            for ( unsigned i = 0; i < 20000; ++i ) { work.invoke(); other.invoke(); }
+            done = true;
+        });
+        while ( !done.load() ) probe.check();
+        emitter.join();
+        Probe::remove( &probe );
+
+        check( "watchdog_consistent", mixed == 0 );
+    }
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+struct Tick
+{
+    uint64_t seq;
+    double price;
+    int32_t size;
+};
+
+// Tick and level of event i (level events are declared halfway)
+Tick make_tick( unsigned i ) { Tick t = { i, 100.0 + (i % 7) * 0.25, int32_t(i % 3) - 1 }; return t; }
+uint16_t make_level( unsigned i ) { return i * 31; }
+
+bool same_tick( const void *p, const Tick& t )
+{
+    Tick r;
+    memcpy( &r, p, sizeof(Tick) );
+    return r.seq == t.seq && r.price == t.price && r.size == t.size;
+}
+
+void check_journal()
+{
+    if ( !selected("journal") ) return;
+
+    // Record 10000 events on two channels, while a second thread drains
+    // the full segments
+    const unsigned n = 10000;
+    VirtualClock clock( 5 );
+    ScopedClock scoped( clock );
+    std::stringstream stream;
+    {
+        Signal<Tick> ticks;
+        JournalWriter writer( stream, 256 );
+        writer.record( &ticks, "ticks" );
+
+        std::atomic<bool> done( false );
+        std::thread drainer( [&]{ while ( !done ) writer.drain(); } );
+
+        unsigned levels = 0;
+        for ( unsigned i = 0; i < n; ++i )
+        {
+            clock.advance( 1 + i % 5 );
+            if ( i == n/2 ) levels = writer.declare<uint16_t>( "levels" );
+            if ( i >= n/2 && i % 2 ) writer.write( levels, make_level(i) );
+            else { ticks.data = make_tick(i); ticks.invoke(); }
+        }
+        done = true;
+        drainer.join();
+    }
+
+    // Replay: same events, times and channels, in order
+    const std::string bytes = stream.str();
+    std::stringstream in( bytes );
+    JournalReader reader( in );
+    bool same = reader.good();
+    unsigned i = 0;
+    uint64_t time = 5;
+    while ( same && reader.next() )
+        for ( size_t k = 0; same && k < reader.events(); ++k, ++i )
+        {
+            time += 1 + i % 5;
+            const bool level = i >= n/2 && i % 2;
+            uint16_t l;
+            if ( level ) memcpy( &l, reader.payload(k), 2 );
+            same = reader.time(k) == time && reader.channel_of(k) == unsigned(level) &&
+                ( level ? l == make_level(i) : same_tick( reader.payload(k), make_tick(i) ) );
+        }
+    check( "journal_round_trip", same && i == n );
+
+    // Truncated or corrupted journals end the replay without reading out of bounds
+    bool safe = true;
+    for ( size_t cut = 5; cut < bytes.size(); cut += 97 )
+    {
+        std::string broken = bytes.substr( 0, cut );
+        if ( cut % 2 ) broken[ cut/2 ] ^= 0x80;
+        std::stringstream b( broken );
+        JournalReader r( b );
+        safe = safe && r.replay() <= n;
+    }
+    check( "journal_corrupted", safe );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_alloc()
+{
+    if ( !selected("alloc") ) return;
+
+    AllocTracker& tracker = AllocTracker::instance();
+    tracker.on_violation( nullptr );
+    tracker.reset();
+    Probe::install( &tracker );
+    tracker.enable();
+
+    // Emissions in every storage form do not allocate
+    const SlotStorage::Form forms[] = { SlotStorage::small, SlotStorage::flat, SlotStorage::indexed };
+    const unsigned sizes[] = { 3, 10, 2000 };
+    bool quiet = true;
+    for ( unsigned f = 0; f < 3; ++f )
+    {
+        Signal<int> signal;
+        vector<Counter> c( sizes[f] );
+        make_form( signal, c, forms[f] );
+        tracker.watch( &signal );
+        for ( unsigned i = 0; i < 10; ++i ) signal.invoke();
+        quiet = quiet && tracker.violations( &signal ) == 0;
+    }
+    check( "alloc_invoke", quiet );
+
+    // Recording into a journal which is drained in time does not allocate
+    {
+        std::stringstream stream;
+        Signal<Tick> ticks;
+        JournalWriter writer( stream, 64 );
+        writer.record( &ticks, "ticks" );
+        tracker.watch( &ticks );
+        for ( unsigned i = 0; i < 64 * 20; ++i )
+        {
+            ticks.data = make_tick(i);
+            ticks.invoke();
+            if ( i % 64 == 63 ) writer.drain();
+        }
+        check( "alloc_journal", tracker.violations( &ticks ) == 0 && tracker.count( alloc_copy ) == 0 );
+    }
+
+    // Queues and copies of events are attributed to their operation
+    {
+        Dispatcher d;
+        ShardedSignal<int> sharded;
+        Counter c;
+        c.slot.subscribe( sharded.local( &d ) );
+        sharded.invoke( 1 );
+        d.poll();
+        check( "alloc_queue", c.calls == 1 && tracker.count( alloc_queue ) > 0 && tracker.count( alloc_copy ) > 0 );
+    }
+
+    // Plain subscriptions, and the conversions they cause, are attributed
+    {
+        Signal<int> signal;
+        vector<Counter> c( 2000 );
+        tracker.reset();
+        make_form( signal, c, SlotStorage::indexed );
+        for ( auto& x: c ) x.slot.unsubscribe();
+        check( "alloc_subscribe", tracker.count( alloc_subscribe ) > 0 && tracker.count( alloc_other ) == 0 );
+    }
+
+    tracker.enable( false );
+    Probe::remove( &tracker );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_perthread()
+{
+    if ( !selected("perthread") ) return;
+
+    // Values are per owner and per thread
+    PerThread<int> a, b;
+    a.local() = 1;
+    b.local() = 2;
+    int other = 0;
+    std::thread( [&]{ other = a.local(); a.local() = 3; } ).join();
+    check( "perthread_values", a.local() == 1 && b.local() == 2 && other == 0 && a.size() == 2 && b.size() == 1 );
+
+    // Probes installed together, more than fit in the cache, each see every event
+    const unsigned n = PerThreadCache::cache_size + 2;
+    std::vector< std::unique_ptr<StatsProbe> > probes;
+    for ( unsigned i = 0; i < n; ++i )
+    {
+        probes.emplace_back( new StatsProbe() );
+        Probe::install( probes.back().get() );
+    }
+
+    Signal<int> signal;
+    Counter c;
+    c.slot.subscribe( &signal );
+    signal.invoke();
+    std::thread( [&]{ for ( unsigned i = 0; i < 10; ++i ) signal.invoke(); } ).join();
+
+    bool all = c.calls == 11;
+    for ( auto& p: probes )
+    {
+        Probe::remove( p.get() );
+        all = all && p->snapshot().signals[ &signal ].emits == 11;
+    }
+    check( "perthread_probes", all );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+typedef EventNode<int> Node;
+typedef TreeEvent<int> NodeEvent;
+
+vector<string> visits;
+Node *doomed = nullptr;
+
+void visit_stop( const NodeEvent& e ) { visits.push_back("stop"); e.stop(); }
+void visit_leaf( const NodeEvent& ) { visits.push_back("leaf"); }
+void visit_mid( const NodeEvent& ) { visits.push_back("mid"); }
+void visit_root( const NodeEvent& ) { visits.push_back("root"); }
+void destroy_doomed( const NodeEvent& ) { visits.push_back("destroy"); delete doomed; doomed = nullptr; }
+
+void check_tree()
+{
+    if ( !selected("tree") ) return;
+
+    // Stopping during the capture at the target still calls its bubble
+    // listeners, but not those of its ancestors
+    {
+        Node root, mid( &root ), leaf( &mid );
+        Slot<NodeEvent> stop( &visit_stop ), at_leaf( &visit_leaf ), at_mid( &visit_mid );
+        stop.subscribe( &leaf.capture );
+        at_leaf.subscribe( &leaf.bubble );
+        at_mid.subscribe( &mid.bubble );
+
+        visits.clear();
+        bool done = leaf.emit( 1 );
+        check( "tree_stop_at_target", !done && visits == vector<string>({ "stop", "leaf" }) );
+    }
+
+    // An ancestor destroyed during the emission is skipped
+    {
+        Node root;
+        doomed = new Node( &root );
+        Node leaf( doomed );
+        Slot<NodeEvent> destroy( &destroy_doomed ), at_mid( &visit_mid ), at_root( &visit_root );
+        destroy.subscribe( &leaf.capture );
+        at_mid.subscribe( &doomed->bubble );
+        at_root.subscribe( &root.bubble );
+
+        visits.clear();
+        bool done = leaf.emit( 1 );
+        check( "tree_destroy_ancestor", done && visits == vector<string>({ "destroy", "root" }) && !leaf.parent() );
+    }
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_rt()
+{
+    if ( !selected("rt") ) return;
+
+    // Subscribers beyond the capacity are reported, and not called
+    RtSignal<int> signal( 2 );
+    vector<Counter> c( 5 );
+    for ( auto& x: c ) x.slot.subscribe( &signal );
+    signal.invoke();
+
+    unsigned called = 0;
+    for ( auto& x: c ) called += x.calls;
+    check( "rt_capacity", called == 2 && signal.overflow() );
+
+    c[4].slot.unsubscribe(); c[3].slot.unsubscribe(); c[2].slot.unsubscribe();
+    signal.invoke();
+    called = 0;
+    for ( auto& x: c ) called += x.calls;
+    check( "rt_resync", called == 4 && !signal.overflow() );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_bridge()
+{
+    if ( !selected("bridge") ) return;
+
+    int fds[2];
+    if ( !bridge_socketpair( fds ) ) { check( "bridge_socketpair", false ); return; }
+
+    // Events are delivered in order, by frames of the writer batch size
+    {
+        Signal<int> local;
+        SignalWriter<int> writer( fds[0], 4 );
+        SignalReader<int> reader( fds[1], 4 );
+        writer.subscribe( &local );
+
+        Counter c;
+        c.slot.subscribe( &reader.mirror );
+        for ( unsigned i = 0; i < 8; ++i ) local.invoke();
+        bool ok = reader.receive() && reader.receive();
+        check( "bridge_frames", ok && c.calls == 8 && !reader.error() );
+    }
+
+    // A frame announcing more events than the reader accepts is rejected
+    // before anything is allocated or read
+    {
+        SignalReader<int> reader( fds[1], 4 );
+        BridgeHeader header;
+        header.count = 1u << 30;
+        bool sent = ::write( fds[0], &header, sizeof(header) ) == sizeof(header);
+        check( "bridge_max_batch", sent && !reader.receive() && reader.error() && !reader.receive() );
+    }
+
+    ::close( fds[0] );
+    ::close( fds[1] );
+
+    // Once the peer has closed, events are dropped instead of piling up
+    if ( !bridge_socketpair( fds ) ) { check( "bridge_socketpair", false ); return; }
+    ::close( fds[1] );
+    {
+        Signal<int> local;
+        SignalWriter<int> writer( fds[0], 4 );
+        writer.subscribe( &local );
+
+        bool bounded = true;
+        for ( unsigned i = 0; i < 1000; ++i ) { local.invoke(); bounded = bounded && writer.pending() < 4; }
+        check( "bridge_closed_peer", bounded && writer.error() && writer.dropped() >= 996 );
+    }
+    ::close( fds[0] );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+Executor *executor = nullptr;
+bool worker_seen = false;
+void note_worker( void*, const void* ) { worker_seen = executor->in_worker(); }
+
+void check_sharded()
+{
+    if ( !selected("sharded") ) return;
+
+    // One task per destination Dispatcher, whatever its number of subscribers
+    Dispatcher d1, d2;
+    ShardedSignal<int> sharded;
+    vector<Counter> c( 5 );
+    for ( unsigned i = 0; i < 5; ++i ) c[i].slot.subscribe( sharded.local( i < 3 ? &d1 : &d2 ) );
+
+    sharded.invoke( 7 );
+    unsigned tasks1 = d1.poll(), tasks2 = d2.poll();
+    bool once = true;
+    for ( auto& x: c ) once = once && x.calls == 1;
+    check( "sharded_one_hop", sharded.threads() == 2 && tasks1 == 1 && tasks2 == 1 && once &&
+        sharded.local( &d1 ) == sharded.local( &d1 ) && !sharded.local( nullptr ) );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_executor()
+{
+    if ( !selected("executor") ) return;
+
+    // Workers are recognised, so that waiting for themselves is caught
+    Executor e( 2 );
+    executor = &e;
+    e.shard(1).post( &note_worker, nullptr, nullptr );
+    e.wait();
+    check( "executor_in_worker", worker_seen && !e.in_worker() );
+
+    // Partitioned signals take Slots, but cannot pass for a synchronous Signal
+    PartitionedSignal<int> partitioned( e, []( const int& x ) { return size_t(x); } );
+    Counter c;
+    c.slot.subscribe( &partitioned );
+    for ( int i = 0; i < 4; ++i ) partitioned.invoke( i );
+    e.wait();
+    check( "executor_partitioned",
+        !std::is_convertible< PartitionedSignal<int>&, Signal<int>& >::value && c.calls == 4 );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+void check_pmu()
+{
+    if ( !selected("pmu") ) return;
+
+    // Each thread counts with its own counters, closed when it exits, even
+    // when a later thread gets the same id
+    PmuProbe probe;
+    Probe::install( &probe );
+
+    Signal<int> signal;
+    Counter c;
+    c.slot.subscribe( &signal );
+
+    bool closed = true, consistent = true;
+    unsigned counted = 0;
+    for ( unsigned t = 0; t < 3; ++t )
+    {
+        int fds[pmu_n_events];
+        std::thread( [&]{
+            signal.invoke();
+            const PmuCounters& pmu = PmuCounters::local();
+            counted += pmu.any();
+            for ( unsigned e = 0; e < pmu_n_events; ++e )
+            {
+                fds[e] = pmu.fd(e);
+                consistent = consistent && probe.available(e) == ( fds[e] >= 0 );
+            }
+        }).join();
+
+        for ( unsigned e = 0; e < pmu_n_events; ++e )
+            closed = closed && ( fds[e] < 0 || ::fcntl( fds[e], F_GETFD ) == -1 );
+    }
+    Probe::remove( &probe );
+
+    uint64_t calls = probe.snapshot()[ subscription_type( &signal, &c.slot ) ].calls;
+    check( "pmu_thread_counters", c.calls == 3 && closed && consistent && calls == counted );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+struct Stamp
+{
+    unsigned producer, index;
+};
+
+// Records the events of a SequencedSignal, with their sequence number
+struct StampLog
+{
+    MemberSlot<StampLog,Stamp> slot;
+    const Sequencer *sequencer;
+    vector<Stamp> stamps;
+    vector<uint64_t> numbers;
+
+    StampLog( const Sequencer *s ): sequencer(s) { slot.bind( this, &StampLog::record ); }
+
+    void record( const Stamp& s )
+    {
+        stamps.push_back(s);
+        numbers.push_back( sequencer->sequence() );
+    }
+};
+
+void noop_task( void*, const void* ) {}
+
+void check_sequencer()
+{
+    if ( !selected("sequencer") ) return;
+
+    // Three producers emit concurrently; both Slots see one order, numbered
+    // without gaps, which preserves the order of each producer
+    const unsigned producers = 3, n = 2000;
+    Sequencer sequencer;
+    StampLog first( &sequencer ), second( &sequencer );
+    {
+        SequencedSignal<Stamp> signal( sequencer );
+        first.slot.subscribe( &signal );
+        second.slot.subscribe( &signal );
+
+        std::thread consumer( [&]{ sequencer.run(); } );
+        vector<std::thread> threads;
+        for ( unsigned p = 0; p < producers; ++p )
+            threads.emplace_back( [&signal,p]{
+                for ( unsigned i = 0; i < n; ++i ) signal.invoke( Stamp{ p, i } );
+            });
+        for ( auto& t: threads ) t.join();
+
+        sequencer.stop();
+        consumer.join();
+    }
+
+    bool same = first.stamps.size() == producers * n && second.stamps.size() == first.stamps.size();
+    vector<unsigned> next( producers, 0 );
+    for ( size_t k = 0; same && k < first.stamps.size(); ++k )
+    {
+        const Stamp& a = first.stamps[k];
+        const Stamp& b = second.stamps[k];
+        same = a.producer == b.producer && a.index == b.index &&
+            first.numbers[k] == k+1 && second.numbers[k] == k+1 &&
+            a.index == next[ a.producer ]++;
+    }
+    check( "sequencer_total_order", same &&
+        !std::is_convertible< SequencedSignal<Stamp>&, Signal<Stamp>& >::value );
+
+    // Tasks are counted before they can be collected, so the number of
+    // pending tasks never wraps below zero while producers post
+    {
+        const unsigned posts = 200000;
+        std::atomic<unsigned> done( 0 );
+        vector<std::thread> threads;
+        for ( unsigned p = 0; p < producers; ++p )
+            threads.emplace_back( [&]{
+                for ( unsigned i = 0; i < posts; ++i ) sequencer.post( &noop_task, nullptr, nullptr );
+                ++done;
+            });
+
+        bool bounded = true;
+        unsigned ran = 0;
+        while ( done.load() < producers || sequencer.pending() )
+        {
+            bounded = bounded && sequencer.pending() <= producers * posts;
+            ran += sequencer.poll();
+        }
+        for ( auto& t: threads ) t.join();
+        check( "sequencer_pending", bounded && ran == producers * posts );
+    }
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+// Each task logs its label and the time at which it runs
+VirtualClock *timer_clock = nullptr;
+Timers *timer_queue = nullptr;
+string timer_log;
+
+void log_task( void*, const void *label )
+{
+    timer_log += *static_cast<const char*>(label);
+    timer_log += std::to_string( timer_clock->now() ) + " ";
+}
+
+void reschedule_task( void *target, const void *label )
+{
+    log_task( target, label );
+    timer_queue->after( 5, &log_task, nullptr, std::make_shared<const char>('r') );
+}
+
+std::shared_ptr<const char> label( char c ) { return std::make_shared<const char>(c); }
+
+void check_timers()
+{
+    if ( !selected("timers") ) return;
+
+    VirtualClock clock( 0 );
+    ScopedClock scoped( clock );
+    Timers timers;
+    timer_clock = &clock;
+    timer_queue = &timers;
+
+    // Tasks run at their own deadlines, in order, including those scheduled
+    // on the way; equal deadlines run in scheduling order
+    timer_log.clear();
+    timers.at( 30, &log_task, nullptr, label('d') );
+    timers.at( 10, &reschedule_task, nullptr, label('a') );
+    timers.at( 20, &log_task, nullptr, label('b') );
+    timers.at( 20, &log_task, nullptr, label('c') );
+    Timers::id_type late = timers.at( 40, &log_task, nullptr, label('x') );
+
+    clock.advance( 25, timers );
+    bool ordered = timer_log == "a10 r15 b20 c20 " && clock.now() == 25;
+    bool cancelled = timers.cancel( late ) && !timers.cancel( late );
+    clock.advance( 100, timers );
+    check( "timers_virtual_order", ordered && cancelled && timer_log == "a10 r15 b20 c20 d30 " && timers.empty() );
+
+    // Dispatchers run their timers when polled after the clock moves
+    timer_log.clear();
+    Dispatcher d;
+    d.post_after( 50, &log_task, nullptr, label('p') );
+    unsigned early = d.poll();
+    clock.advance( 50 );
+    unsigned due = d.poll();
+    check( "timers_dispatcher", early == 0 && due == 1 && timer_log == "p175 " && d.scheduled() == 0 );
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+int main( int argc, char *argv[] )
+{
+    if ( argc > 1 ) filter = argv[1];
+
+    check_storage();
+    check_spatial();
+    check_wiring();
+    check_interest();
+    check_trace();
+    check_graph();
+    check_shm();
+    check_watchdog();
+    check_journal();
+    check_alloc();
+    check_perthread();
+    check_tree();
+    check_rt();
+    check_bridge();
+    check_sharded();
+    check_executor();
+    check_pmu();
+    check_sequencer();
+    check_timers();
+
+    cout << failures << " failure(s)" << endl;
+    return failures;
+}
@@ -0,0 +1,241 @@
+#ifndef __SIGLOT_CLOCK__
+#define __SIGLOT_CLOCK__
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+
+//=============================================
+// @filename     siglot_clock.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Source of time, in nanoseconds from an arbitrary origin.
+ */
+class Clock
+{
+public:
+	virtual ~Clock() {}
+	virtual uint64_t now() const =0;
+};
+
+inline uint64_t steady_now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch() ).count();
+}
+
+class SteadyClock
+	: public Clock
+{
+public:
+	inline uint64_t now() const { return steady_now(); }
+};
+
+/**
+ * Clock that only moves when told to, for tests and simulations: hours of
+ * simulated traffic run as fast as the callbacks allow.
+ *
+ * - set( t )             : jump to a given time (never backwards)
+ * - advance( d )         : move forward by d ns
+ * - advance( d, timers ) : same, running the timers that fall due on the
+ *                          way, each at its own deadline
+ */
+class Timers;
+class VirtualClock
+	: public Clock
+{
+public:
+
+	explicit VirtualClock( uint64_t start = 0 ): time(start) {}
+
+	inline uint64_t now() const { return time.load(std::memory_order_acquire); }
+
+	void set( uint64_t t )
+	{
+		if ( t > now() ) time.store( t, std::memory_order_release );
+	}
+
+	inline void advance( uint64_t d ) { set( now() + d ); }
+	inline void advance( uint64_t d, Timers& timers );
+
+protected:
+
+	std::atomic<uint64_t> time;
+};
+
+
+
+/**
+ * Clock used by all time-dependent features: probes (stats, traces, shared
+ * statistics, watchdog), journals and timers. It is the steady clock unless
+ * another one is installed; installing a clock does not change the times
+ * already recorded, so do it before starting to record.
+ */
+inline std::atomic<const Clock*>& _clock_instance()
+{
+	static std::atomic<const Clock*> c(nullptr);
+	return c;
+}
+
+// Install a clock (nullptr restores the steady clock); it must outlive its use
+inline void set_clock( const Clock *c ) { _clock_instance().store( c, std::memory_order_release ); }
+
+inline const Clock* get_clock() { return _clock_instance().load(std::memory_order_acquire); }
+
+inline uint64_t clock_now()
+{
+	const Clock *c = _clock_instance().load(std::memory_order_acquire);
+	return c ? c->now() : steady_now();
+}
+
+/**
+ * Installs a clock for the lifetime of the object, eg in a test.
+ */
+class ScopedClock
+{
+public:
+
+	explicit ScopedClock( const Clock& c ): previous(get_clock()) { set_clock(&c); }
+	~ScopedClock() { set_clock(previous); }
+
+	ScopedClock( const ScopedClock& ) = delete;
+	ScopedClock& operator= ( const ScopedClock& ) = delete;
+
+protected:
+
+	const Clock *previous;
+};
+
+
+
+/**
+ * Tasks run at given times of the installed clock (see clock_now).
+ *
+ * A task is a function pointer applied to a target and a payload, held by
+ * shared pointers, as for Dispatchers. Tasks run in deadline order, and in
+ * scheduling order for equal deadlines. Timers do not run by themselves:
+ * see run_due, VirtualClock::advance, or the timers of a Dispatcher.
+ *
+ * NOTE:
+ * Timers are not thread-safe; Dispatchers guard their own.
+ */
+class Timers
+{
+public:
+
+	typedef void (*function_type)( void *target, const void *payload );
+	typedef uint64_t id_type;
+
+	static const uint64_t never = ~uint64_t(0);
+
+	struct Task
+	{
+		uint64_t deadline;
+		id_type id;
+		function_type function;
+		std::shared_ptr<void> target;
+		std::shared_ptr<const void> payload;
+
+		inline void operator() () const { function( target.get(), payload.get() ); }
+	};
+
+	Timers(): last_id(0) {}
+
+	// Schedule a task at a given time, or after a given delay (ns)
+	id_type at( uint64_t deadline, function_type f, std::shared_ptr<void> target, std::shared_ptr<const void> payload )
+	{
+		heap.push_back( Task{ deadline, ++last_id, f, std::move(target), std::move(payload) } );
+		std::push_heap( heap.begin(), heap.end(), &Timers::_later );
+		return last_id;
+	}
+
+	inline id_type after( uint64_t delay, function_type f, std::shared_ptr<void> target, std::shared_ptr<const void> payload )
+	{
+		return at( clock_now() + delay, f, std::move(target), std::move(payload) );
+	}
+
+	// Remove a scheduled task; returns false if it already ran
+	bool cancel( id_type id )
+	{
+		auto it = std::find_if( heap.begin(), heap.end(), [id]( const Task& t ){ return t.id == id; } );
+		if ( it == heap.end() ) return false;
+
+		heap.erase(it);
+		std::make_heap( heap.begin(), heap.end(), &Timers::_later );
+		return true;
+	}
+
+	inline bool empty() const { return heap.empty(); }
+	inline size_t size() const { return heap.size(); }
+	inline void clear() { heap.clear(); }
+
+	// Deadline of the next task (never if none)
+	inline uint64_t next() const { return heap.empty() ? uint64_t(never) : heap.front().deadline; }
+
+	// Move the tasks due at a given time to the back of a vector, in order
+	unsigned take_due( uint64_t now, std::vector<Task>& out )
+	{
+		unsigned n = 0;
+		for ( ; !heap.empty() && heap.front().deadline <= now; ++n )
+		{
+			std::pop_heap( heap.begin(), heap.end(), &Timers::_later );
+			out.push_back( std::move(heap.back()) );
+			heap.pop_back();
+		}
+		return n;
+	}
+
+	// Run the tasks due now, including those they schedule for now or before
+	unsigned run_due()
+	{
+		unsigned n = 0;
+		std::vector<Task> due;
+		while ( take_due( clock_now(), due ) )
+		{
+			for ( auto& t: due ) t();
+			n += due.size();
+			due.clear();
+		}
+		return n;
+	}
+
+protected:
+
+	// Heap order: earliest deadline first, then first scheduled
+	inline static bool _later( const Task& a, const Task& b )
+	{
+		return a.deadline != b.deadline ? a.deadline > b.deadline : a.id > b.id;
+	}
+
+	std::vector<Task> heap;
+	id_type last_id;
+};
+
+inline void VirtualClock::advance( uint64_t d, Timers& timers )
+{
+	const uint64_t target = now() + d;
+	std::vector<Timers::Task> due;
+	while ( timers.next() <= target )
+	{
+		set( timers.next() );
+		timers.take_due( now(), due );
+		for ( auto& t: due ) t();
+		due.clear();
+	}
+	set( target );
+}
+
+}
+
+#endif
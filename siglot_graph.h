@@ -0,0 +1,226 @@
+#ifndef __SIGLOT_GRAPH__
+#define __SIGLOT_GRAPH__
+
+#include "siglot_stats.h"
+
+#include <set>
+#include <map>
+#include <mutex>
+#include <string>
+#include <cstdio>
+#include <ostream>
+
+//=============================================
+// @filename     siglot_graph.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Runtime view of the Signal graph:
+ * - nodes are live Signals and Slots;
+ * - subscriptions link a Signal to each of its Slots;
+ * - forwards link a Slot to each Signal invoked from its callback.
+ * Activity counters come from the StatsSnapshot taken at the same time.
+ */
+struct SignalGraph
+{
+	typedef StatsSnapshot::edge_type edge_type;
+
+	std::set<const void*> signals;
+	std::set<edge_type> subscriptions; // (signal, slot)
+	std::map<const void*, std::string> names;
+	StatsSnapshot stats;
+
+	// Label of a node: its name if any, its address otherwise
+	std::string label( const void *p ) const
+	{
+		auto it = names.find(p);
+		if ( it != names.end() ) return it->second;
+
+		char buf[32];
+		snprintf( buf, sizeof(buf), "%p", p );
+		return buf;
+	}
+
+	// Export in Graphviz format; the width of subscription edges is
+	// proportional to their share of the total callback time.
+	void export_dot( std::ostream& os ) const
+	{
+		double total = _total_time();
+
+		os << "digraph siglot {\n  rankdir=LR;\n";
+		for ( auto s: signals )
+		{
+			auto it = stats.signals.find(s);
+			os << "  \"" << s << "\" [shape=ellipse,label=\"" << _escape(label(s))
+			   << "\\nemits " << (it == stats.signals.end() ? 0 : it->second.emits) << "\"];\n";
+		}
+		for ( auto& e: subscriptions )
+		{
+			auto it = stats.slots.find(e.second);
+			uint64_t calls = 0, time = 0;
+			if ( it != stats.slots.end() ) { calls = it->second.calls; time = it->second.callback.sum; }
+
+			double share = total > 0 ? time / total : 0.0;
+			os << "  \"" << e.second << "\" [shape=box,label=\"" << _escape(label(e.second)) << "\"];\n"
+			   << "  \"" << e.first << "\" -> \"" << e.second << "\" [label=\"" << calls << " calls\\n"
+			   << time / 1000 << " us\",penwidth=" << 1 + 9*share
+			   << (share > 0.25 ? ",color=red" : "") << "];\n";
+		}
+		for ( auto& f: stats.forwards )
+			os << "  \"" << f.first.first << "\" -> \"" << f.first.second
+			   << "\" [style=dashed,label=\"" << f.second << " emits\"];\n";
+		os << "}\n";
+	}
+
+	// Export as JSON: { "signals": [...], "slots": [...], "forwards": [...] }
+	void export_json( std::ostream& os ) const
+	{
+		os << "{\"signals\":[";
+		bool first = true;
+		for ( auto s: signals )
+		{
+			auto it = stats.signals.find(s);
+			os << (first ? "" : ",") << "\n{\"id\":\"" << s << "\",\"name\":\"" << _escape(label(s))
+			   << "\",\"emits\":" << (it == stats.signals.end() ? 0 : it->second.emits) << "}";
+			first = false;
+		}
+
+		os << "],\"slots\":[";
+		first = true;
+		for ( auto& e: subscriptions )
+		{
+			auto it = stats.slots.find(e.second);
+			os << (first ? "" : ",") << "\n{\"id\":\"" << e.second << "\",\"name\":\""
+			   << _escape(label(e.second)) << "\",\"signal\":\"" << e.first << "\",\"calls\":"
+			   << (it == stats.slots.end() ? 0 : it->second.calls) << ",\"time_ns\":"
+			   << (it == stats.slots.end() ? 0 : it->second.callback.sum) << "}";
+			first = false;
+		}
+
+		os << "],\"forwards\":[";
+		first = true;
+		for ( auto& f: stats.forwards )
+		{
+			os << (first ? "" : ",") << "\n{\"slot\":\"" << f.first.first << "\",\"signal\":\""
+			   << f.first.second << "\",\"emits\":" << f.second << "}";
+			first = false;
+		}
+		os << "]}\n";
+	}
+
+protected:
+
+	double _total_time() const
+	{
+		double t = 0;
+		for ( auto& e: subscriptions )
+		{
+			auto it = stats.slots.find(e.second);
+			if ( it != stats.slots.end() ) t += it->second.callback.sum;
+		}
+		return t;
+	}
+
+	static std::string _escape( const std::string& s )
+	{
+		std::string out;
+		for ( char c: s )
+			if ( c == '"' || c == '\\' ) { out += '\\'; out += c; }
+			else if ( static_cast<unsigned char>(c) >= 0x20 ) out += c;
+		return out;
+	}
+};
+
+
+
+/**
+ * Probe tracking the topology of the Signal graph on top of the StatsProbe
+ * counters (see siglot.h, SIGLOT_INSTRUMENT). Every callback is timed, so
+ * that cumulative times per edge are exact.
+ *
+ * Topology changes (construction, destruction, subscriptions) take a lock;
+ * emissions and callbacks do not. Signals created before the probe was
+ * installed appear as soon as a Slot subscribes to them.
+ */
+class GraphProbe
+	: public StatsProbe
+{
+public:
+
+	GraphProbe(): StatsProbe(1) {}
+
+	// Label a Signal or a Slot in the exported graph
+	void name( const void *p, const std::string& label )
+	{
+		std::lock_guard<std::mutex> lock(graph_mutex);
+		names[p] = label;
+	}
+
+	// Current topology, annotated with activity counters
+	SignalGraph graph() const
+	{
+		SignalGraph g;
+		g.stats = snapshot();
+
+		std::lock_guard<std::mutex> lock(graph_mutex);
+		g.signals = signals;
+		for ( auto& s: subscribers )
+			for ( auto slot: s.second ) g.subscriptions.insert( SignalGraph::edge_type(s.first, slot) );
+		g.names = names;
+
+		// Forwards from dead nodes are not part of the live graph
+		std::set<const void*> slots;
+		for ( auto& e: g.subscriptions ) slots.insert( e.second );
+		for ( auto it = g.stats.forwards.begin(); it != g.stats.forwards.end(); )
+			if ( slots.count(it->first.first) && signals.count(it->first.second) ) ++it;
+			else it = g.stats.forwards.erase(it);
+
+		return g;
+	}
+
+	void signal_create( const void *signal )
+	{
+		std::lock_guard<std::mutex> lock(graph_mutex);
+		signals.insert( signal );
+	}
+
+	void signal_destroy( const void *signal )
+	{
+		std::lock_guard<std::mutex> lock(graph_mutex);
+		signals.erase( signal );
+		subscribers.erase( signal );
+		names.erase( signal );
+	}
+
+	void subscribe( const void *signal, const void *slot )
+	{
+		std::lock_guard<std::mutex> lock(graph_mutex);
+		signals.insert( signal );
+		subscribers[signal].insert( slot );
+	}
+
+	void unsubscribe( const void *signal, const void *slot )
+	{
+		std::lock_guard<std::mutex> lock(graph_mutex);
+		auto it = subscribers.find( signal );
+		if ( it != subscribers.end() ) it->second.erase( slot );
+	}
+
+protected:
+
+	mutable std::mutex graph_mutex;
+	std::set<const void*> signals;
+	std::map< const void*, std::set<const void*> > subscribers;
+	std::map<const void*, std::string> names;
+};
+
+}
+
+#endif
@@ -0,0 +1,643 @@
+#ifndef __SIGLOT_JOURNAL__
+#define __SIGLOT_JOURNAL__
+
+#include "siglot.h"
+#include "siglot_alloc.h"
+#include "siglot_clock.h"
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <algorithm>
+
+//=============================================
+// @filename     siglot_journal.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Compact journal of Signal streams.
+ *
+ * A journal records the events of several Signals (channels), with their
+ * time of emission. Events are buffered, and written in segments of
+ * "segment_size" events, in columns:
+ *
+ *     file    : "SGJ1" frame...
+ *     frame   : [ uint8 type ][ varint length ][ body ]
+ *     declare : (type 'D') varint channel, varint size, name
+ *     segment : (type 'S') varint n, then the columns:
+ *               - channel of each event, in order of emission (varint);
+ *               - time of each event, as a delta from the previous one (varint);
+ *               - for each channel in the segment, in increasing order, and
+ *                 for each 64-bits word of its payload: a mode byte, then one
+ *                 varint per event of the channel, being either the XOR
+ *                 (mode 0) or the zigzag delta (mode 1) against the same word
+ *                 of the previous event of the channel.
+ *
+ * The mode of each column is chosen per segment, as the shorter encoding:
+ * XOR suits flags and values of which few bits change, delta suits counters
+ * and measurements. Unchanged words cost one byte per event.
+ *
+ * Recording an event copies it into preallocated segment buffers, encodes
+ * its channel and time, and updates the size of both encodings of each word
+ * of its payload; its cost is bounded by its size. Full segments are queued,
+ * and the payload columns are only encoded when they are written (see
+ * JournalWriter::drain). Payloads are copied bytewise, so data types must be
+ * trivially copyable, with the same layout when replayed.
+ */
+namespace journal
+{
+	// Write at most 10 bytes
+	inline void put_varint( unsigned char *& p, uint64_t v )
+	{
+		while ( v >= 0x80 ) { *p++ = (v & 0x7f) | 0x80; v >>= 7; }
+		*p++ = v;
+	}
+
+	inline void put_varint( std::string& out, uint64_t v )
+	{
+		unsigned char tmp[10], *p = tmp;
+		put_varint( p, v );
+		out.append( reinterpret_cast<char*>(tmp), p - tmp );
+	}
+
+	// Read a varint which ends before "end"; false if it does not
+	inline bool get_varint( const unsigned char *& p, const unsigned char *end, uint64_t& v )
+	{
+		if ( p < end && *p < 0x80 ) { v = *p++; return true; }
+
+		v = 0;
+		for ( unsigned shift = 0; p < end && shift < 64; shift += 7 )
+		{
+			const uint64_t b = *p++;
+			v |= (b & 0x7f) << shift;
+			if ( b < 0x80 ) return true;
+		}
+		return false;
+	}
+
+	// Same without bounds, when at least 10 bytes remain
+	inline uint64_t get_varint( const unsigned char *& p )
+	{
+		if ( *p < 0x80 ) return *p++;
+
+		uint64_t v = 0;
+		for ( unsigned shift = 0; shift < 64; shift += 7 )
+		{
+			uint64_t b = *p++;
+			v |= (b & 0x7f) << shift;
+			if ( b < 0x80 ) break;
+		}
+		return v;
+	}
+
+	inline unsigned varint_size( uint64_t v ) { return (70 - __builtin_clzll(v | 1)) / 7; }
+
+	inline uint64_t zigzag( uint64_t delta ) { return (delta << 1) ^ uint64_t( int64_t(delta) >> 63 ); }
+	inline uint64_t unzigzag( uint64_t z ) { return (z >> 1) ^ (0 - (z & 1)); }
+
+	inline unsigned words( size_t bytes ) { return (bytes + 7) / 8; }
+}
+
+
+
+/**
+ * Writing end: records Signals into a stream.
+ *
+ * - record( signal, name ): subscribe to a Signal, as a new channel
+ * - write( channel, data ) : record an event explicitly
+ * - drain()                : write the full segments
+ * - flush()                : write all the buffered events
+ *
+ * Recording does not write to the stream: full segments are queued, and
+ * written by drain, which the caller runs when convenient (eg from a timer
+ * of its Dispatcher), or which a background thread runs in a loop. Segments
+ * are recycled once written, so recording does not allocate, unless drain
+ * falls behind by more than "spares" segments.
+ *
+ * NOTE:
+ * drain may run concurrently with recording; all other methods must be
+ * called by the recording thread. flush and the destructor call drain.
+ */
+class JournalWriter
+{
+public:
+
+	explicit JournalWriter( std::ostream& os, unsigned segment_size = 4096, unsigned spares = 2 )
+		: os(os), segment_size(segment_size ? segment_size : 1),
+		  last_time(0), n_in(0), n_out(4)
+	{
+		os.write( "SGJ1", 4 );
+		current.reset( _make() );
+		for ( unsigned i = 0; i < spares; ++i ) spare.emplace_back( _make() );
+		ready.reserve( spares + 16 );
+		writing.reserve( spares + 16 );
+	}
+
+	~JournalWriter() { flush(); }
+
+	JournalWriter( const JournalWriter& ) = delete;
+	JournalWriter& operator= ( const JournalWriter& ) = delete;
+
+	// Declare a channel, and record all events of a Signal
+	template <typename data_type>
+	unsigned record( Signal<data_type> *signal, const std::string& name )
+	{
+		unsigned c = declare<data_type>(name);
+		Recorder<data_type> *r = new Recorder<data_type>( this, c );
+		recorders.emplace_back(r);
+		r->subscribe(signal);
+		return c;
+	}
+
+	// Declare a channel, to be written explicitly
+	template <typename data_type>
+	unsigned declare( const std::string& name )
+	{
+		static_assert( std::is_trivially_copyable<data_type>::value,
+			"Journaled data types must be trivially copyable." );
+
+		const unsigned c = channels.size();
+		channels.push_back( Channel( sizeof(data_type) ) );
+
+		// The declaration is written before the segments which follow it
+		Segment *d = new Segment();
+		d->type = 'D';
+		journal::put_varint( d->body, c );
+		journal::put_varint( d->body, sizeof(data_type) );
+		d->body += name;
+
+		_fit( *current );
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		for ( auto& s: spare ) _fit( *s );
+		ready.emplace_back(d);
+		return c;
+	}
+
+	template <typename data_type>
+	inline void write( unsigned channel, const data_type& data )
+	{
+		append( channel, &data, clock_now() );
+	}
+
+	// Record the payload of a channel at a given time (ns)
+	void append( unsigned channel, const void *data, uint64_t time )
+	{
+		SIGLOT_ALLOC_SCOPE( alloc_copy );
+		using namespace journal;
+		Channel& ch = channels[channel];
+		Segment& s = *current;
+		Column& col = s.columns[channel];
+
+		// First event of the channel in this segment
+		if ( col.n == 0 ) std::copy( ch.last.begin(), ch.last.end(), col.base.begin() );
+
+		uint64_t *raw = &col.raw[ col.n++ * ch.words ];
+		raw[ ch.words-1 ] = 0;
+		memcpy( raw, data, ch.size );
+
+		uint64_t *last = ch.last.data();
+		for ( unsigned w = 0; w < ch.words; ++w )
+		{
+			col.xor_size[w]   += varint_size( raw[w] ^ last[w] );
+			col.delta_size[w] += varint_size( zigzag( raw[w] - last[w] ) );
+			last[w] = raw[w];
+		}
+
+		unsigned char *p = &s.order[ s.order_size ];
+		put_varint( p, channel );
+		s.order_size = p - s.order.data();
+
+		p = &s.times[ s.times_size ];
+		put_varint( p, time - last_time );
+		s.times_size = p - s.times.data();
+		last_time = time;
+
+		n_in += ch.size + 8;
+		if ( ++s.events >= segment_size ) _seal();
+	}
+
+	// Write the full segments; returns the number of frames written
+	unsigned drain()
+	{
+		std::lock_guard<std::mutex> write_lock(write_mutex);
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			writing.swap(ready);
+		}
+
+		for ( auto& s: writing ) _write( *s );
+		const unsigned n = writing.size();
+
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		for ( auto& s: writing )
+			if ( s->type == 'S' ) { _reset( *s ); spare.push_back( std::move(s) ); }
+		writing.clear();
+		return n;
+	}
+
+	// Write all the buffered events, including those of the segment in progress
+	void flush()
+	{
+		if ( current->events ) _seal();
+		drain();
+	}
+
+	// Number of frames waiting to be written
+	size_t pending() const
+	{
+		std::lock_guard<std::mutex> lock(queue_mutex);
+		return ready.size();
+	}
+
+	// Bytes of payloads and timestamps recorded, and bytes written
+	inline uint64_t bytes_in() const { return n_in; }
+	inline uint64_t bytes_out() const { return n_out.load(std::memory_order_relaxed); }
+
+protected:
+
+	// Recorders of any type, for ownership
+	struct RecorderBase { virtual ~RecorderBase() {} };
+
+	template <typename data_type>
+	class Recorder
+		: public ListenerInterface<data_type>, public RecorderBase
+	{
+	public:
+		Recorder( JournalWriter *w, unsigned c ): writer(w), channel(c) {}
+		~Recorder() { this->unsubscribe(); }
+
+	protected:
+		inline void operator() ( const data_type& data ) { writer->write( channel, data ); }
+
+		JournalWriter *writer;
+		unsigned channel;
+	};
+
+	struct Channel
+	{
+		size_t size;
+		unsigned words;
+		std::vector<uint64_t> last; // words of the last event
+
+		Channel( size_t s ): size(s), words( journal::words(s) ), last( journal::words(s), 0 ) {}
+	};
+
+	// Payload words of a channel in a segment, and the size of both encodings
+	struct Column
+	{
+		size_t n;
+		unsigned words;
+		std::vector<uint64_t> raw, base, xor_size, delta_size;
+	};
+
+	// Segment, or channel declaration (type 'D')
+	struct Segment
+	{
+		char type;
+		size_t events, order_size, times_size;
+		std::vector<unsigned char> order, times; // encoded columns
+		std::vector<Column> columns;
+		std::string body;
+
+		Segment(): type('S'), events(0), order_size(0), times_size(0) {}
+	};
+
+	typedef std::vector< std::unique_ptr<Segment> > queue_type;
+
+	std::ostream& os;
+	unsigned segment_size;
+	std::vector<Channel> channels;
+	std::vector< std::unique_ptr<RecorderBase> > recorders;
+	uint64_t last_time, n_in;
+	std::atomic<uint64_t> n_out;
+
+	std::unique_ptr<Segment> current;
+	queue_type ready, spare, writing;
+	mutable std::mutex queue_mutex;
+	std::mutex write_mutex;
+	std::string body; // encoded by drain
+
+	Segment* _make()
+	{
+		Segment *s = new Segment();
+		s->order.resize( 5 * segment_size );
+		s->times.resize( 10 * segment_size );
+		_fit( *s );
+		return s;
+	}
+
+	// Add the columns of the channels declared since a segment was made
+	void _fit( Segment& s )
+	{
+		while ( s.columns.size() < channels.size() )
+		{
+			const unsigned W = channels[ s.columns.size() ].words;
+			s.columns.emplace_back();
+			Column& col = s.columns.back();
+			col.n = 0;
+			col.words = W;
+			col.raw.resize( size_t(segment_size) * W );
+			col.base.resize( W );
+			col.xor_size.resize( W );
+			col.delta_size.resize( W );
+		}
+	}
+
+	void _reset( Segment& s )
+	{
+		s.events = s.order_size = s.times_size = 0;
+		for ( auto& col: s.columns )
+		{
+			col.n = 0;
+			std::fill( col.xor_size.begin(), col.xor_size.end(), 0 );
+			std::fill( col.delta_size.begin(), col.delta_size.end(), 0 );
+		}
+	}
+
+	// Queue the segment in progress, and continue with a spare one
+	void _seal()
+	{
+		SIGLOT_ALLOC_SCOPE( alloc_queue );
+		std::unique_ptr<Segment> next;
+		{
+			std::lock_guard<std::mutex> lock(queue_mutex);
+			ready.push_back( std::move(current) );
+			if ( !spare.empty() ) { next = std::move(spare.back()); spare.pop_back(); }
+		}
+
+		if ( next ) _fit( *next );
+		else next.reset( _make() );
+		current = std::move(next);
+	}
+
+	// Encode the payload columns of a segment, and write it
+	void _write( const Segment& s )
+	{
+		using namespace journal;
+		if ( s.type != 'S' ) { _frame( s.type, s.body.data(), s.body.size() ); return; }
+
+		// Upper bound of the encoded size
+		size_t bound = 10 + s.order_size + s.times_size;
+		for ( auto& col: s.columns ) bound += col.n ? col.words * (1 + 10*col.n) : 0;
+		if ( body.size() < bound ) body.resize( bound );
+
+		unsigned char *p = reinterpret_cast<unsigned char*>( &body[0] );
+		put_varint( p, s.events );
+		p = std::copy( s.order.data(), s.order.data() + s.order_size, p );
+		p = std::copy( s.times.data(), s.times.data() + s.times_size, p );
+
+		for ( auto& col: s.columns )
+			for ( unsigned w = 0; col.n && w < col.words; ++w )
+			{
+				const bool delta = col.delta_size[w] < col.xor_size[w];
+				*p++ = delta;
+
+				uint64_t prev = col.base[w];
+				for ( size_t i = 0; i < col.n; ++i )
+				{
+					const uint64_t v = col.raw[ i*col.words + w ];
+					put_varint( p, delta ? zigzag( v - prev ) : v ^ prev );
+					prev = v;
+				}
+			}
+
+		_frame( 'S', body.data(), p - reinterpret_cast<unsigned char*>( &body[0] ) );
+	}
+
+	void _frame( char type, const char *data, size_t size )
+	{
+		unsigned char head[11], *p = head;
+		*p++ = type;
+		journal::put_varint( p, size );
+		os.write( reinterpret_cast<char*>(head), p - head );
+		os.write( data, size );
+		n_out.fetch_add( (p - head) + size, std::memory_order_relaxed );
+	}
+};
+
+
+
+/**
+ * Reading end: decodes a journal, and replays it through mirror Signals.
+ *
+ * - channel<T>( name ): mirror Signal of a channel (nullptr if unknown)
+ * - next()            : decode the next segment; false at the end
+ * - replay()          : invoke the mirror Signals of all remaining events,
+ *                       in order of emission; returns their number
+ * - events(), time(i), channel_of(i), payload(i): events of the current segment
+ */
+class JournalReader
+{
+public:
+
+	explicit JournalReader( std::istream& is ): is(is), n_events(0), last_time(0), ok(false)
+	{
+		char magic[4];
+		ok = is.read( magic, 4 ) && memcmp( magic, "SGJ1", 4 ) == 0;
+		_read_frame(); // channel declarations which come first
+	}
+
+	inline bool good() const { return ok; }
+
+	template <typename data_type>
+	Signal<data_type>* channel( const std::string& name )
+	{
+		for ( auto& ch: channels )
+		{
+			if ( ch.name != name || ch.size != sizeof(data_type) ) continue;
+			if ( !ch.mirror )
+			{
+				ch.mirror  = std::shared_ptr<void>( new Signal<data_type>(),
+					[]( void *p ){ delete static_cast<Signal<data_type>*>(p); } );
+				ch.deliver = &_deliver<data_type>;
+			}
+			return static_cast<Signal<data_type>*>( ch.mirror.get() );
+		}
+		return nullptr;
+	}
+
+	// Decode the next segment
+	bool next()
+	{
+		n_events = 0;
+		while ( ok && n_events == 0 )
+			if ( !_read_frame() ) return false;
+		return n_events > 0;
+	}
+
+	inline size_t events() const { return n_events; }
+	inline uint64_t time( size_t i ) const { return times[i]; }
+	inline unsigned channel_of( size_t i ) const { return order[i]; }
+	inline const void* payload( size_t i ) const { return &channels[order[i]].decoded[ index[i] * channels[order[i]].words ]; }
+
+	size_t replay()
+	{
+		size_t n = 0;
+		while ( next() )
+			for ( size_t i = 0; i < n_events; ++i, ++n )
+			{
+				Channel& ch = channels[order[i]];
+				if ( ch.deliver ) ch.deliver( ch.mirror.get(), payload(i) );
+			}
+		return n;
+	}
+
+protected:
+
+	struct Channel
+	{
+		std::string name;
+		size_t size;
+		unsigned words;
+		std::vector<uint64_t> decoded, last;
+		std::shared_ptr<void> mirror;
+		void (*deliver)( void*, const void* );
+		size_t count;
+
+		Channel(): size(0), words(0), deliver(nullptr), count(0) {}
+	};
+
+	std::istream& is;
+	std::vector<Channel> channels;
+	std::vector<unsigned> order;
+	std::vector<uint64_t> times;
+	std::vector<size_t> index;
+	std::vector<unsigned char> buffer;
+	size_t n_events;
+	uint64_t last_time;
+	bool ok;
+
+	template <typename data_type>
+	static void _deliver( void *signal, const void *payload )
+	{
+		Signal<data_type> *s = static_cast<Signal<data_type>*>(signal);
+		memcpy( &s->data, payload, sizeof(data_type) );
+		s->invoke();
+	}
+
+	// Read one frame; declarations are processed until a segment is decoded
+	bool _read_frame()
+	{
+		using namespace journal;
+		for ( ;; )
+		{
+			int type = is.get();
+			if ( type == EOF ) return false;
+
+			uint64_t length = 0;
+			for ( unsigned shift = 0; ; shift += 7 )
+			{
+				int b = is.get();
+				if ( b == EOF || shift > 63 ) return ok = false;
+				length |= uint64_t(b & 0x7f) << shift;
+				if ( b < 0x80 ) break;
+			}
+
+			// Grow the buffer as the data arrives, so that a corrupted length
+			// fails at the end of the stream rather than allocating
+			for ( size_t got = 0; got < length; )
+			{
+				const size_t step = std::min<uint64_t>( length - got, 1 << 20 );
+				if ( buffer.size() < got + step ) buffer.resize( got + step );
+				if ( !is.read( reinterpret_cast<char*>(&buffer[got]), step ) ) return ok = false;
+				got += step;
+			}
+
+			const unsigned char *p = buffer.data(), *end = p + length;
+			if ( type == 'D' )
+			{
+				uint64_t c, size;
+				if ( !get_varint( p, end, c ) || !get_varint( p, end, size ) || c > channels.size() )
+					return ok = false;
+
+				if ( c == channels.size() ) channels.resize( c+1 );
+				channels[c].size  = size;
+				channels[c].words = words( size );
+				channels[c].last.clear();
+				channels[c].name.assign( reinterpret_cast<const char*>(p), end - p );
+
+				// Keep reading until the first segment
+				if ( is.peek() == 'S' || is.peek() == EOF ) return true;
+				continue;
+			}
+			if ( type == 'S' ) return _decode( p, end );
+		}
+	}
+
+	bool _decode( const unsigned char *p, const unsigned char *end )
+	{
+		using namespace journal;
+
+		// Each event takes at least one byte
+		uint64_t events, v;
+		if ( !get_varint( p, end, events ) || events > size_t(end - p) ) return ok = false;
+
+		order.resize(events);
+		times.resize(events);
+		index.resize(events);
+
+		for ( auto& ch: channels ) ch.count = 0;
+		for ( size_t i = 0; i < events; ++i )
+		{
+			if ( !get_varint( p, end, v ) || v >= channels.size() ) return ok = false;
+			order[i] = v;
+			index[i] = channels[v].count++;
+		}
+		for ( size_t i = 0; i < events; ++i )
+		{
+			if ( !get_varint( p, end, v ) ) return ok = false;
+			times[i] = last_time += v;
+		}
+
+		for ( auto& ch: channels )
+		{
+			const size_t n = ch.count, W = ch.words;
+			if ( n == 0 ) continue;
+
+			// Each word takes a mode byte and one byte per event
+			if ( W > size_t(end - p) / (n+1) ) return ok = false;
+			if ( ch.last.size() != W ) ch.last.assign( W, 0 );
+
+			ch.decoded.resize( n * W );
+			for ( unsigned w = 0; w < W; ++w )
+			{
+				const bool delta = *p++;
+				uint64_t prev = ch.last[w];
+				uint64_t *out = &ch.decoded[w];
+				bool valid = true;
+				if ( size_t(end - p) >= 10*n )
+				{
+					if ( delta )
+						for ( size_t i = 0; i < n; ++i, out += W ) *out = prev += unzigzag( get_varint(p) );
+					else
+						for ( size_t i = 0; i < n; ++i, out += W ) *out = prev ^= get_varint(p);
+				}
+				else if ( delta )
+					for ( size_t i = 0; i < n; ++i, out += W ) { valid &= get_varint( p, end, v ); *out = prev += unzigzag(v); }
+				else
+					for ( size_t i = 0; i < n; ++i, out += W ) { valid &= get_varint( p, end, v ); *out = prev ^= v; }
+				if ( !valid ) return ok = false;
+				ch.last[w] = prev;
+			}
+		}
+		n_events = events;
+		return true;
+	}
+};
+
+}
+
+#endif
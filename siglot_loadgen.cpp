@@ -0,0 +1,217 @@
+#include "siglot.h"
+#include "siglot_stats.h"
+#include <map>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+using namespace std;
+using namespace siglot;
+
+//=============================================
+// Synthetic load generator.
+//
+// Builds a randomized, layered Signal graph: root Signals receive external
+// events, and each Slot may forward the event to a Signal of the next layer,
+// up to the configured depth. The graph is driven at a target event rate
+// while Slots churn, and the tool reports throughput, end-to-end latency
+// percentiles of root events, and memory use.
+//
+// Usage: siglot_loadgen [key=value]...
+//
+//     signals=1000      number of Signals per layer
+//     depth=3           number of layers
+//     fanout=8          mean number of Slots per Signal
+//     fanout_dist=exp   fan-out distribution: const, uniform, exp (heavy tail)
+//     forward=0.2       probability that a Slot forwards to the next layer
+//     payload=64        payload size in bytes
+//     cost_ns=100       mean callback cost (busy loop), exponentially distributed
+//     churn=1000        subscription changes per second
+//     rate=100000       target root events per second (0 = as fast as possible)
+//     seconds=5         duration of the run
+//     seed=1            random seed
+//=============================================
+
+
+
+map<string,double> params = {
+    {"signals",1000}, {"depth",3}, {"fanout",8}, {"forward",0.2}, {"payload",64},
+    {"cost_ns",100}, {"churn",1000}, {"rate",100000}, {"seconds",5}, {"seed",1}
+};
+string fanout_dist = "exp";
+
+typedef chrono::steady_clock load_clock;
+
+inline uint64_t now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>( load_clock::now().time_since_epoch() ).count();
+}
+
+/**
+ * Payloads have a fixed maximum size; "payload" bytes of it are copied
+ * along each forwarding edge.
+ */
+struct Event
+{
+    uint32_t size;
+    char bytes[4096];
+};
+
+// Number of callbacks run, at all depths
+uint64_t deliveries = 0;
+
+/**
+ * A Slot of the graph, bound to its handler with a MemberSlot.
+ * The handler spins for its cost, and may forward to a Signal of the next layer.
+ */
+struct Node
+{
+    MemberSlot<Node,Event> slot;
+    unsigned layer;
+    uint64_t cost;
+    Signal<Event> *next;
+
+    Node(): layer(0), cost(0), next(nullptr) { slot.bind( this, &Node::handle ); }
+
+    void handle( const Event& e )
+    {
+        ++deliveries;
+        for ( uint64_t t0 = now_ns(); now_ns() - t0 < cost; );
+        if ( next )
+        {
+            next->data.size = e.size;
+            memcpy( next->data.bytes, e.bytes, e.size );
+            next->invoke();
+        }
+    }
+};
+
+/**
+ * Resident memory of the process in kB (Linux), 0 if unknown.
+ */
+uint64_t resident_kb()
+{
+    ifstream status( "/proc/self/status" );
+    string line;
+    while ( getline(status,line) )
+        if ( line.compare(0,6,"VmRSS:") == 0 ) return atoll( line.c_str() + 6 );
+    return 0;
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+int main( int argc, char *argv[] )
+{
+    for ( int i = 1; i < argc; ++i )
+    {
+        string arg = argv[i];
+        size_t eq = arg.find('=');
+        if ( eq == string::npos ) { cerr << "Ignored argument " << arg << endl; continue; }
+
+        string key = arg.substr(0,eq), value = arg.substr(eq+1);
+        if ( key == "fanout_dist" ) fanout_dist = value;
+        else if ( params.count(key) ) params[key] = atof(value.c_str());
+        else cerr << "Unknown parameter " << key << endl;
+    }
+
+    const unsigned n_signals = params["signals"], depth = max( 1.0, params["depth"] );
+    const unsigned payload   = min( params["payload"], double(sizeof(Event::bytes)) );
+    mt19937_64 rng( params["seed"] );
+
+    auto draw_fanout = [&]() -> unsigned {
+        double mean = params["fanout"];
+        if ( fanout_dist == "const" ) return mean;
+        if ( fanout_dist == "uniform" ) return uniform_int_distribution<unsigned>( 0, 2*mean )(rng);
+        return exponential_distribution<double>( 1.0 / max(mean, 1e-9) )(rng);
+    };
+    exponential_distribution<double> draw_cost( 1.0 / max(params["cost_ns"], 1e-9) );
+    bernoulli_distribution draw_forward( params["forward"] );
+
+    /**
+     * Build the graph, layer by layer.
+     */
+    uint64_t rss0 = resident_kb();
+    auto t_build = load_clock::now();
+
+    vector< unique_ptr< Signal<Event>[] > > layers;
+    vector< unique_ptr<Node> > nodes;
+    for ( unsigned l = 0; l < depth; ++l )
+        layers.emplace_back( new Signal<Event>[n_signals] );
+
+    for ( unsigned l = 0; l < depth; ++l )
+        for ( unsigned s = 0; s < n_signals; ++s )
+            for ( unsigned k = draw_fanout(); k > 0; --k )
+            {
+                nodes.emplace_back( new Node() );
+                Node& n = *nodes.back();
+                n.layer = l;
+                n.cost = params["cost_ns"] > 0 ? draw_cost(rng) : 0;
+                if ( l+1 < depth && draw_forward(rng) )
+                    n.next = &layers[l+1][ uniform_int_distribution<unsigned>(0, n_signals-1)(rng) ];
+                n.slot.subscribe( &layers[l][s] );
+            }
+
+    double build_s = chrono::duration<double>( load_clock::now() - t_build ).count();
+    uint64_t rss1 = resident_kb();
+
+    /**
+     * Drive the roots at the target rate; latency is measured from the
+     * scheduled time of each event, so that falling behind shows in the tail.
+     */
+    const double rate = params["rate"], churn = params["churn"];
+    const uint64_t duration = params["seconds"] * 1e9;
+    uniform_int_distribution<unsigned> draw_root( 0, n_signals-1 );
+    uniform_int_distribution<size_t> draw_node( 0, nodes.empty() ? 0 : nodes.size()-1 );
+
+    Histogram latency;
+    uint64_t events = 0, changes = 0;
+    const uint64_t start = now_ns();
+
+    for ( uint64_t now = start; now - start < duration; now = now_ns() )
+    {
+        // Subscription churn: move random Slots to random Signals of their layer
+        while ( churn > 0 && !nodes.empty() && changes < (now - start) * 1e-9 * churn )
+        {
+            Node& n = *nodes[ draw_node(rng) ];
+            n.slot.unsubscribe();
+            n.slot.subscribe( &layers[n.layer][ draw_root(rng) ] );
+            ++changes;
+        }
+
+        uint64_t scheduled = rate > 0 ? start + events * 1e9 / rate : now;
+        if ( scheduled > now ) continue;
+
+        Signal<Event>& root = layers[0][ draw_root(rng) ];
+        root.data.size = payload;
+        root.invoke();
+        latency.record( now_ns() - scheduled );
+        ++events;
+    }
+
+    double run_s = (now_ns() - start) * 1e-9;
+
+    /**
+     * Report.
+     */
+    cout << "graph: " << depth << " layers x " << n_signals << " signals, " << nodes.size()
+         << " slots (" << fanout_dist << " fan-out, mean " << params["fanout"] << ")\n"
+         << "build: " << build_s << " s, memory: " << (rss1 - rss0) << " kB for the graph, "
+         << rss1 << " kB resident\n"
+         << "throughput: " << events / run_s << " root events/s (target " << rate << "), "
+         << deliveries / run_s << " callbacks/s, " << changes / run_s << " changes/s\n"
+         << "latency (us): p50 " << latency.percentile(.5) * 1e-3 << ", p99 "
+         << latency.percentile(.99) * 1e-3 << ", p99.9 " << latency.percentile(.999) * 1e-3
+         << ", max " << latency.max * 1e-3 << endl;
+}
@@ -0,0 +1,467 @@
+#include "siglot.h"
+#include "siglot_stats.h"
+#include "siglot_bridge.h"
+#include "siglot_thread.h"
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <algorithm>
+
+using namespace std;
+using namespace siglot;
+
+//=============================================
+// Multithreaded benchmarks: scaling of emitters and subscription churn on
+// shared Signals from 1 to N threads, fan-out to subscribers on N threads,
+// key-partitioned dispatch on N shards, total order of N producers, and
+// latency of cross-thread delivery.
+//
+// The output is CSV on stdout:
+//
+//     benchmark,threads,ops,mops_per_sec,p50_ns,p99_ns,p999_ns
+//
+// Throughput cases leave the percentiles empty; latency cases report them
+// per event, from a log-linear histogram (12.5% precision).
+//
+// Usage: siglot_mtbench [duration_ms=200] [max_threads=hardware] [filter]
+//=============================================
+
+
+
+typedef chrono::steady_clock bench_clock;
+
+unsigned duration_ms = 200, max_threads = 0;
+string filter;
+
+inline uint64_t now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>( bench_clock::now().time_since_epoch() ).count();
+}
+
+/**
+ * Callbacks only touch thread-local data, so that the measures reflect the
+ * cost of dispatch and synchronization rather than of the callbacks.
+ */
+thread_local uint64_t local_sink = 0;
+void callback( const uint64_t& x ) { local_sink += x; }
+
+bool selected( const string& name ) { return filter.empty() || name.find(filter) != string::npos; }
+
+void print_throughput( const string& name, unsigned threads, uint64_t ops, double seconds )
+{
+    cout << name << ',' << threads << ',' << ops << ',' << ops / seconds * 1e-6 << ",,," << endl;
+}
+
+void print_latency( const string& name, unsigned threads, const Histogram& h )
+{
+    cout << name << ',' << threads << ',' << h.total << ",," << h.percentile(.5) << ','
+         << h.percentile(.99) << ',' << h.percentile(.999) << endl;
+}
+
+/**
+ * Run "body(thread_index, stop)" on n threads for the configured duration,
+ * and return the sum of the operation counts they return.
+ */
+template <typename F>
+uint64_t run_threads( unsigned n, F body, double& seconds )
+{
+    atomic<bool> stop(false), go(false);
+    vector<uint64_t> ops(n, 0);
+    vector<thread> threads;
+
+    for ( unsigned t = 0; t < n; ++t )
+        threads.emplace_back( [&, t]() {
+            while ( !go.load() ) this_thread::yield();
+            ops[t] = body( t, stop );
+        });
+
+    auto t0 = bench_clock::now();
+    go = true;
+    this_thread::sleep_for( chrono::milliseconds(duration_ms) );
+    stop = true;
+    for ( auto& t: threads ) t.join();
+    seconds = chrono::duration<double>( bench_clock::now() - t0 ).count();
+
+    uint64_t total = 0;
+    for ( auto o: ops ) total += o;
+    return total;
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+/**
+ * Concurrent emitters on one Signal with 100 subscribers.
+ * - shared_invoke: invoke() does not modify the storage (unless it is
+ *   adaptive), so concurrent emitters need no lock as long as nobody
+ *   subscribes meanwhile (and the data is not modified);
+ * - locked_invoke: emitters serialize on a mutex, as required when other
+ *   threads modify subscriptions.
+ */
+void bench_emitters( unsigned threads )
+{
+    const unsigned subscribers = 100;
+    Signal<uint64_t> signal;
+    unique_ptr< Slot<uint64_t>[] > slots( new Slot<uint64_t>[subscribers] );
+    for ( unsigned i = 0; i < subscribers; ++i )
+    {
+        slots[i].bind( &callback );
+        slots[i].subscribe( &signal );
+    }
+
+    double seconds;
+    if ( selected("shared_invoke") )
+    {
+        uint64_t ops = run_threads( threads, [&]( unsigned, atomic<bool>& stop ) {
+            uint64_t n = 0;
+            for ( ; !stop.load(memory_order_relaxed); ++n ) signal.invoke();
+            return n * subscribers;
+        }, seconds );
+        print_throughput( "shared_invoke", threads, ops, seconds );
+    }
+
+    if ( selected("locked_invoke") )
+    {
+        mutex m;
+        uint64_t ops = run_threads( threads, [&]( unsigned, atomic<bool>& stop ) {
+            uint64_t n = 0;
+            for ( ; !stop.load(memory_order_relaxed); ++n )
+            {
+                lock_guard<mutex> lock(m);
+                signal.invoke();
+            }
+            return n * subscribers;
+        }, seconds );
+        print_throughput( "locked_invoke", threads, ops, seconds );
+    }
+}
+
+/**
+ * Subscription churn: each thread subscribes and unsubscribes its own Slot
+ * on a shared Signal (guarded by a mutex), while thread 0 also emits.
+ */
+void bench_churn( unsigned threads )
+{
+    if ( !selected("locked_churn") ) return;
+
+    Signal<uint64_t> signal;
+    mutex m;
+    double seconds;
+
+    uint64_t ops = run_threads( threads, [&]( unsigned t, atomic<bool>& stop ) {
+        Slot<uint64_t> slot( &callback );
+        uint64_t n = 0;
+        for ( ; !stop.load(memory_order_relaxed); ++n )
+        {
+            lock_guard<mutex> lock(m);
+            if ( t == 0 ) signal.invoke();
+            if ( slot.is_active() ) slot.unsubscribe();
+            else slot.subscribe( &signal );
+        }
+        lock_guard<mutex> lock(m);
+        slot.clear();
+        return n;
+    }, seconds );
+    print_throughput( "locked_churn", threads, ops, seconds );
+}
+
+/**
+ * Cross-thread delivery through a bridge over a socket pair (siglot_bridge.h):
+ * - bridge_one_way: events carry their emission time, the receiving thread
+ *   records the delay;
+ * - bridge_round_trip: the receiving thread echoes each event back through
+ *   a second bridge, and the emitter records the round trip;
+ * - bridge_all_keys / bridge_interest: throughput of events over 1000 keys,
+ *   of which the receiver listens to one, sent either all, or only when
+ *   wanted according to an InterestMap.
+ */
+struct Stamp { uint64_t sent; };
+
+Histogram *one_way_hist = nullptr;
+void on_one_way( const Stamp& s ) { one_way_hist->record( now_ns() - s.sent ); }
+
+void bench_bridge()
+{
+    const unsigned events = 20000;
+
+    if ( selected("bridge_one_way") )
+    {
+        int fds[2];
+        if ( !bridge_socketpair(fds) ) return;
+
+        Histogram h;
+        one_way_hist = &h;
+
+        Signal<Stamp> source;
+        SignalWriter<Stamp> writer( fds[0], 1 );
+        SignalReader<Stamp> reader( fds[1] );
+        Slot<Stamp> sink( &on_one_way );
+        writer.subscribe( &source );
+        sink.subscribe( &reader.mirror );
+
+        thread receiver( [&]{ reader.run(); } );
+        for ( unsigned i = 0; i < events; ++i )
+        {
+            source.data.sent = now_ns();
+            source.invoke();
+
+            // Pace the emitter, so that the delay does not include queueing
+            for ( uint64_t t = now_ns(); now_ns() - t < 2000; );
+        }
+        ::shutdown( fds[0], SHUT_WR );
+        receiver.join();
+        ::close(fds[0]); ::close(fds[1]);
+
+        print_latency( "bridge_one_way", 2, h );
+    }
+
+    if ( selected("bridge_round_trip") )
+    {
+        int ping[2], pong[2];
+        if ( !bridge_socketpair(ping) || !bridge_socketpair(pong) ) return;
+
+        Histogram h;
+        Signal<Stamp> source;
+        SignalWriter<Stamp> ping_writer( ping[0], 1 ), pong_writer( pong[0], 1 );
+        SignalReader<Stamp> ping_reader( ping[1] ), pong_reader( pong[1] );
+
+        // The receiving thread echoes events as they arrive
+        ping_writer.subscribe( &source );
+        pong_writer.subscribe( &ping_reader.mirror );
+
+        thread echo( [&]{ ping_reader.run(); } );
+        for ( unsigned i = 0; i < events; ++i )
+        {
+            source.data.sent = now_ns();
+            source.invoke();
+            if ( !pong_reader.receive() ) break;
+            h.record( now_ns() - pong_reader.mirror.data.sent );
+        }
+        ::shutdown( ping[0], SHUT_WR );
+        echo.join();
+        for ( int fd: { ping[0], ping[1], pong[0], pong[1] } ) ::close(fd);
+
+        print_latency( "bridge_round_trip", 2, h );
+    }
+
+    for ( const char *name: { "bridge_all_keys", "bridge_interest" } )
+    {
+        if ( !selected(name) ) continue;
+
+        int fds[2];
+        InterestMap interests;
+        if ( !bridge_socketpair(fds) || !interests.create() ) return;
+
+        Signal<Stamp> source;
+        SignalWriter<Stamp> writer( fds[0] );
+        SignalReader<Stamp> reader( fds[1] );
+        Slot<Stamp> sink( [](const Stamp& s){ local_sink += s.sent; } );
+        writer.subscribe( &source );
+        sink.subscribe( &reader.mirror );
+
+        Interest wanted( interests, 7 );
+        if ( string(name) == "bridge_interest" )
+            writer.interest( &interests, []( const Stamp& s ){ return s.sent; } );
+
+        thread receiver( [&]{ reader.run(); } );
+        double seconds;
+        uint64_t ops = run_threads( 1, [&]( unsigned, atomic<bool>& stop ) {
+            uint64_t n = 0;
+            for ( ; !stop.load(memory_order_relaxed); ++n )
+            {
+                source.data.sent = n % 1000;
+                source.invoke();
+            }
+            writer.flush();
+            return n;
+        }, seconds );
+        ::shutdown( fds[0], SHUT_WR );
+        receiver.join();
+        ::close(fds[0]); ::close(fds[1]);
+
+        print_throughput( name, 2, ops, seconds );
+    }
+}
+
+
+
+/**
+ * Fan-out to 10k subscribers spread over N threads, each running a Dispatcher:
+ * - sharded_fanout: one task per destination thread (ShardedSignal);
+ * - queued_per_slot: one task per subscriber, as with per-Slot queued delivery.
+ * Operations count callbacks.
+ */
+void deliver_one( void *slot, const void *payload )
+{
+    callback( *static_cast<const uint64_t*>(payload) );
+}
+
+void bench_fanout( unsigned threads )
+{
+    const unsigned subscribers = 10000, events = 200;
+    const unsigned per_thread  = subscribers / threads;
+
+    for ( int sharded = 1; sharded >= 0; --sharded )
+    {
+        const char *name = sharded ? "sharded_fanout" : "queued_per_slot";
+        if ( !selected(name) ) continue;
+
+        ShardedSignal<uint64_t> signal;
+        vector< unique_ptr<Dispatcher> > dispatchers;
+        vector< unique_ptr< Slot<uint64_t>[] > > slots;
+        for ( unsigned t = 0; t < threads; ++t )
+        {
+            dispatchers.emplace_back( new Dispatcher() );
+            slots.emplace_back( new Slot<uint64_t>[per_thread] );
+            for ( unsigned i = 0; i < per_thread; ++i )
+            {
+                slots[t][i].bind( &callback );
+                slots[t][i].subscribe( signal.local( dispatchers[t].get() ) );
+            }
+        }
+
+        vector<thread> workers;
+        for ( auto& d: dispatchers ) workers.emplace_back( [&d]{ d->run(); } );
+
+        shared_ptr<void> target;
+        auto t0 = bench_clock::now();
+        for ( uint64_t e = 0; e < events; ++e )
+        {
+            if ( sharded ) { signal.invoke(e); continue; }
+
+            shared_ptr<const void> payload = make_shared<const uint64_t>(e);
+            for ( unsigned t = 0; t < threads; ++t )
+                for ( unsigned i = 0; i < per_thread; ++i )
+                    dispatchers[t]->post( &deliver_one, target, payload );
+        }
+        for ( auto& d: dispatchers ) d->stop();
+        for ( auto& w: workers ) w.join();
+
+        double seconds = chrono::duration<double>( bench_clock::now() - t0 ).count();
+        print_throughput( name, threads, uint64_t(events) * per_thread * threads, seconds );
+    }
+}
+
+/**
+ * Key-partitioned dispatch on N worker shards (PartitionedSignal): events
+ * with 1024 distinct keys, each handled by a callback of about 500 ns.
+ * Operations count events.
+ */
+void busy_callback( const uint64_t& )
+{
+    for ( uint64_t t = now_ns(); now_ns() - t < 500; );
+}
+
+void bench_partitioned( unsigned threads )
+{
+    if ( !selected("partitioned_dispatch") ) return;
+
+    const unsigned events = 20000;
+    Executor executor( threads );
+    PartitionedSignal<uint64_t> signal( executor, []( const uint64_t& x ) { return size_t(x % 1024); } );
+    Slot<uint64_t> slot( &busy_callback );
+    slot.subscribe( &signal );
+
+    auto t0 = bench_clock::now();
+    for ( uint64_t e = 0; e < events; ++e ) signal.invoke(e);
+    executor.wait();
+
+    double seconds = chrono::duration<double>( bench_clock::now() - t0 ).count();
+    print_throughput( "partitioned_dispatch", threads, events, seconds );
+}
+
+/**
+ * Total order of the events of N producer threads, applied to one state:
+ * - mutex_merge: producers emit under a global mutex;
+ * - sequenced_merge: producers post to a Sequencer, whose thread stamps and
+ *   applies the merged stream.
+ * Operations count events, until all are applied.
+ */
+uint64_t merged_state = 0;
+void apply_event( const uint64_t& x ) { merged_state = merged_state * 31 + x; }
+
+void bench_merge( unsigned threads )
+{
+    const uint64_t events = 400000, per_thread = events / threads;
+
+    if ( selected("mutex_merge") )
+    {
+        mutex m;
+        Signal<uint64_t> signal;
+        Slot<uint64_t> slot( &apply_event );
+        slot.subscribe( &signal );
+
+        vector<thread> producers;
+        auto t0 = bench_clock::now();
+        for ( unsigned t = 0; t < threads; ++t )
+            producers.emplace_back( [&]{
+                for ( uint64_t e = 0; e < per_thread; ++e )
+                {
+                    lock_guard<mutex> lock(m);
+                    signal.data = e;
+                    signal.invoke();
+                }
+            });
+        for ( auto& p: producers ) p.join();
+
+        double seconds = chrono::duration<double>( bench_clock::now() - t0 ).count();
+        print_throughput( "mutex_merge", threads, per_thread * threads, seconds );
+    }
+
+    if ( selected("sequenced_merge") )
+    {
+        Sequencer sequencer;
+        SequencedSignal<uint64_t> signal( sequencer );
+        Slot<uint64_t> slot( &apply_event );
+        slot.subscribe( &signal );
+
+        thread runner( [&]{ sequencer.run(); } );
+        vector<thread> producers;
+        auto t0 = bench_clock::now();
+        for ( unsigned t = 0; t < threads; ++t )
+            producers.emplace_back( [&]{
+                for ( uint64_t e = 0; e < per_thread; ++e ) signal.invoke(e);
+            });
+        for ( auto& p: producers ) p.join();
+        sequencer.stop();
+        runner.join();
+
+        double seconds = chrono::duration<double>( bench_clock::now() - t0 ).count();
+        print_throughput( "sequenced_merge", threads, sequencer.sequence(), seconds );
+    }
+}
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+int main( int argc, char *argv[] )
+{
+    if ( argc > 1 ) duration_ms = atoi(argv[1]);
+    max_threads = argc > 2 ? atoi(argv[2]) : thread::hardware_concurrency();
+    if ( argc > 3 ) filter = argv[3];
+    if ( max_threads == 0 ) max_threads = 1;
+
+    cout << "benchmark,threads,ops,mops_per_sec,p50_ns,p99_ns,p999_ns" << endl;
+
+    for ( unsigned t = 1; t <= max_threads; t *= 2 ) bench_emitters(t);
+    for ( unsigned t = 1; t <= max_threads; t *= 2 ) bench_churn(t);
+    for ( unsigned t = 1; t <= max_threads; t *= 2 ) bench_fanout(t);
+    for ( unsigned t = 1; t <= max_threads; t *= 2 ) bench_partitioned(t);
+    for ( unsigned t = 1; t <= max_threads; t *= 2 ) bench_merge(t);
+    bench_bridge();
+}
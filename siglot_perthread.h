@@ -0,0 +1,132 @@
+#ifndef __SIGLOT_PERTHREAD__
+#define __SIGLOT_PERTHREAD__
+
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <utility>
+
+//=============================================
+// @filename     siglot_perthread.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * One value per thread, owned by an object (eg the table of a probe).
+ *
+ * - local( args... ) : value of the calling thread, created on first use
+ * - each( f )        : apply f to the value of each thread, in order of
+ *                      creation, while no value is created
+ * - size()           : number of values
+ *
+ * Values live as long as the owner, including those of exited threads. A
+ * thread finds its value through a small cache shared by all owners: after
+ * the first use, local() takes no lock, as long as the thread does not use
+ * more than "cache_size" owners alternately.
+ */
+class PerThreadCache
+{
+public:
+
+	static const unsigned cache_size = 8;
+
+protected:
+
+	struct Entry
+	{
+		uint64_t owner;
+		void *value;
+	};
+
+	// Owners are numbered, so that an owner allocated at the address of a
+	// destroyed one does not find its values
+	static uint64_t _next_id() { static std::atomic<uint64_t> n(1); return n++; }
+
+	inline static Entry& _entry( uint64_t owner )
+	{
+		static thread_local Entry entries[cache_size] = {};
+		return entries[ owner % cache_size ];
+	}
+};
+
+template <typename T>
+class PerThread
+	: public PerThreadCache
+{
+public:
+
+	typedef T value_type;
+
+	PerThread(): id(_next_id()) {}
+
+	PerThread( const PerThread& ) = delete;
+	PerThread& operator= ( const PerThread& ) = delete;
+
+	template <typename... Args>
+	inline T& local( Args&&... args )
+	{
+		Entry& e = _entry(id);
+		if ( e.owner == id ) return *static_cast<T*>(e.value);
+		return _find( e, std::forward<Args>(args)... );
+	}
+
+	template <typename F>
+	void each( F f ) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		for ( auto& v: values ) f( v->value );
+	}
+
+	inline size_t size() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return values.size();
+	}
+
+protected:
+
+	struct Value
+	{
+		std::thread::id thread;
+		T value;
+
+		template <typename... Args>
+		Value( Args&&... args ): thread(std::this_thread::get_id()), value( std::forward<Args>(args)... ) {}
+	};
+
+	template <typename... Args>
+	T& _find( Entry& e, Args&&... args )
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		T *found = nullptr;
+		for ( auto& v: values )
+			if ( v->thread == std::this_thread::get_id() ) { found = &v->value; break; }
+
+		if ( !found )
+		{
+			values.emplace_back( new Value( std::forward<Args>(args)... ) );
+			found = &values.back()->value;
+		}
+
+		e.owner = id;
+		e.value = found;
+		return *found;
+	}
+
+	uint64_t id;
+	mutable std::mutex mutex;
+	std::vector< std::unique_ptr<Value> > values;
+};
+
+}
+
+#endif
@@ -0,0 +1,349 @@
+#ifndef __SIGLOT_PMU__
+#define __SIGLOT_PMU__
+
+#include "siglot.h"
+#include "siglot_perthread.h"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <utility>
+#include <algorithm>
+#include <unordered_map>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+//=============================================
+// @filename     siglot_pmu.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Hardware events counted around each callback.
+ */
+enum PmuEvent { pmu_cycles, pmu_instructions, pmu_cache_misses, pmu_branch_misses, pmu_n_events };
+
+inline const char* pmu_event_name( unsigned e )
+{
+	static const char *names[] = { "cycles", "instructions", "cache_misses", "branch_misses" };
+	return e < pmu_n_events ? names[e] : "unknown";
+}
+
+/**
+ * Counts of one subscription (Signal, Slot), summed over all threads.
+ */
+struct PmuStats
+{
+	uint64_t calls;
+	uint64_t events[pmu_n_events];
+
+	PmuStats(): calls(0) { for ( auto& e: events ) e = 0; }
+
+	inline double per_call( unsigned e ) const { return calls ? double(events[e]) / calls : 0.0; }
+	inline double ipc() const
+		{ return events[pmu_cycles] ? double(events[pmu_instructions]) / events[pmu_cycles] : 0.0; }
+
+	// Misses per thousand instructions
+	inline double mpki( unsigned e ) const
+		{ return events[pmu_instructions] ? 1e3 * events[e] / events[pmu_instructions] : 0.0; }
+};
+
+typedef std::pair<const void*, const void*> subscription_type; // (signal, slot)
+typedef std::map<subscription_type, PmuStats> PmuSnapshot;
+
+/**
+ * Table of subscriptions, the busiest first, with IPC and misses per
+ * thousand instructions: low IPC with many cache misses suggests a memory
+ * bound handler (layout), many branch misses a data-dependent control flow.
+ */
+inline void pmu_report( std::ostream& os, const PmuSnapshot& snap )
+{
+	std::vector<const PmuSnapshot::value_type*> rows;
+	for ( auto& s: snap ) rows.push_back(&s);
+	std::sort( rows.begin(), rows.end(), []( const PmuSnapshot::value_type *a, const PmuSnapshot::value_type *b ) {
+		return a->second.events[pmu_cycles] > b->second.events[pmu_cycles];
+	});
+
+	os << "signal,slot,calls,cycles_per_call,ipc,cache_mpki,branch_mpki\n";
+	for ( auto r: rows )
+		os << r->first.first << ',' << r->first.second << ',' << r->second.calls << ','
+		   << r->second.per_call(pmu_cycles) << ',' << r->second.ipc() << ','
+		   << r->second.mpki(pmu_cache_misses) << ',' << r->second.mpki(pmu_branch_misses) << '\n';
+}
+
+
+
+/**
+ * Hardware counters of the calling thread (user space only), opened the first
+ * time the thread uses them, and closed when it exits: perf events opened
+ * for the calling thread only count that thread. Events that cannot be
+ * opened read as 0, while the others keep counting.
+ *
+ * On x86, counters are read with rdpmc from the mapped perf page, without
+ * system calls; otherwise, or when the kernel does not allow it, they are
+ * read with read().
+ */
+class PmuCounters
+{
+public:
+
+	// Counters of the calling thread
+	static PmuCounters& local() { static thread_local PmuCounters c; return c; }
+
+	PmuCounters( const PmuCounters& ) = delete;
+	PmuCounters& operator= ( const PmuCounters& ) = delete;
+
+	// Is a given event counted, and is it read without system calls?
+	inline bool available( unsigned e ) const { return fds[e] >= 0; }
+	inline bool user_read( unsigned e ) const { return user[e]; }
+
+	// Is any event counted?
+	inline bool any() const { return n_open > 0; }
+
+	// Descriptor of an event (-1 if it could not be opened)
+	inline int fd( unsigned e ) const { return fds[e]; }
+
+	inline void read( uint64_t *values ) const
+	{
+		for ( unsigned e = 0; e < pmu_n_events; ++e )
+			values[e] = user[e] ? _user_read( pages[e] ) : fds[e] >= 0 ? _sys_read( fds[e] ) : 0;
+	}
+
+protected:
+
+	PmuCounters(): n_open(0)
+	{
+		static const uint64_t configs[pmu_n_events] = {
+			PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES };
+
+		for ( unsigned e = 0; e < pmu_n_events; ++e )
+		{
+			perf_event_attr attr;
+			memset( &attr, 0, sizeof(attr) );
+			attr.size           = sizeof(attr);
+			attr.type           = PERF_TYPE_HARDWARE;
+			attr.config         = configs[e];
+			attr.exclude_kernel = 1;
+			attr.exclude_hv     = 1;
+
+			fds[e]   = syscall( SYS_perf_event_open, &attr, 0, -1, -1, 0 );
+			pages[e] = nullptr;
+			user[e]  = false;
+			if ( fds[e] < 0 ) continue;
+			++n_open;
+
+			void *p = mmap( nullptr, sysconf(_SC_PAGESIZE), PROT_READ, MAP_SHARED, fds[e], 0 );
+			if ( p == MAP_FAILED ) continue;
+			pages[e] = static_cast<perf_event_mmap_page*>(p);
+#if defined(__x86_64__) || defined(__i386__)
+			user[e] = pages[e]->cap_user_rdpmc;
+#endif
+		}
+	}
+
+	~PmuCounters()
+	{
+		for ( unsigned e = 0; e < pmu_n_events; ++e )
+		{
+			if ( pages[e] ) munmap( pages[e], sysconf(_SC_PAGESIZE) );
+			if ( fds[e] >= 0 ) close( fds[e] );
+			fds[e] = -1; pages[e] = nullptr; user[e] = false;
+		}
+		n_open = 0;
+	}
+
+	inline static uint64_t _sys_read( int fd )
+	{
+		uint64_t v = 0;
+		return ::read( fd, &v, sizeof(v) ) == sizeof(v) ? v : 0;
+	}
+
+	// Lock-free read of the mapped counter (see perf_event_open(2))
+	inline static uint64_t _user_read( const volatile perf_event_mmap_page *pc )
+	{
+#if defined(__x86_64__) || defined(__i386__)
+		uint32_t seq, index;
+		uint64_t count;
+		do
+		{
+			seq = pc->lock;
+			__asm__ __volatile__( "" ::: "memory" );
+			index = pc->index;
+			count = pc->offset;
+			if ( index )
+			{
+				uint32_t lo, hi;
+				__asm__ __volatile__( "rdpmc" : "=a"(lo), "=d"(hi) : "c"(index - 1) );
+				int64_t pmc = (uint64_t(hi) << 32) | lo;
+				const unsigned shift = 64 - pc->pmc_width;
+				count += (pmc << shift) >> shift;
+			}
+			__asm__ __volatile__( "" ::: "memory" );
+		}
+		while ( pc->lock != seq );
+		return count;
+#else
+		return 0;
+#endif
+	}
+
+	int fds[pmu_n_events];
+	perf_event_mmap_page *pages[pmu_n_events];
+	bool user[pmu_n_events];
+	unsigned n_open;
+};
+
+
+
+/**
+ * Probe counting hardware events per subscription (see siglot.h,
+ * SIGLOT_INSTRUMENT), through perf_event_open.
+ *
+ * Each thread uses its own counters (PmuCounters), opened the first time it
+ * runs a callback and closed when it exits. Counts include nested emissions.
+ *
+ * Counters may be unavailable (eg perf_event_paranoid, virtual machines):
+ * available( e ) tells which events the calling thread counts; the others
+ * read as 0. When none is available, nothing is recorded.
+ */
+class PmuProbe
+	: public Probe
+{
+public:
+
+	PmuProbe() {}
+
+	PmuProbe( const PmuProbe& ) = delete;
+	PmuProbe& operator= ( const PmuProbe& ) = delete;
+
+	// Can the calling thread count any hardware event, or a given one?
+	bool available() const { return PmuCounters::local().any(); }
+	bool available( unsigned e ) const { return PmuCounters::local().available(e); }
+
+	// Can the calling thread read a given counter without system calls?
+	bool user_read( unsigned e ) const { return PmuCounters::local().user_read(e); }
+
+	// Merge the tables of all threads
+	PmuSnapshot snapshot() const
+	{
+		PmuSnapshot snap;
+		tables.each( [&snap]( ThreadTable& t ){ t.load( snap ); } );
+		return snap;
+	}
+
+	void slot_begin( const void*, const void* )
+	{
+		const PmuCounters& pmu = PmuCounters::local();
+		if ( !pmu.any() ) return;
+
+		Frame& f = _table().push();
+		pmu.read( f.start );
+	}
+
+	void slot_end( const void *signal, const void *slot )
+	{
+		const PmuCounters& pmu = PmuCounters::local();
+		if ( !pmu.any() ) return;
+
+		uint64_t end[pmu_n_events];
+		pmu.read( end );
+
+		ThreadTable& t = _table();
+		Cell& c = t.cell( subscription_type(signal,slot) );
+		const Frame& f = t.top();
+		_add( c.calls, 1 );
+		for ( unsigned e = 0; e < pmu_n_events; ++e ) _add( c.events[e], end[e] - f.start[e] );
+		t.pop();
+	}
+
+protected:
+
+	typedef std::atomic<uint64_t> counter;
+
+	// Single-writer increment: no read-modify-write instruction needed
+	inline static void _add( counter& c, uint64_t n )
+	{
+		c.store( c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed );
+	}
+
+	struct Cell
+	{
+		counter calls;
+		counter events[pmu_n_events];
+		Cell(): calls(0) { for ( auto& e: events ) e.store( 0, std::memory_order_relaxed ); }
+	};
+
+	struct Frame { uint64_t start[pmu_n_events]; };
+
+	struct SubscriptionHash
+	{
+		inline size_t operator() ( const subscription_type& s ) const
+		{
+			return std::hash<const void*>()(s.first) * 31 + std::hash<const void*>()(s.second);
+		}
+	};
+
+	// Tables of one thread (its counters are in PmuCounters)
+	struct ThreadTable
+	{
+		std::mutex mutex;
+		std::unordered_map<subscription_type, Cell, SubscriptionHash> cells;
+		std::vector<Frame> frames;
+		unsigned depth;
+
+		ThreadTable(): frames(16), depth(0) {}
+
+		Cell& cell( const subscription_type& k )
+		{
+			auto it = cells.find(k);
+			if ( it != cells.end() ) return it->second;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			return cells[k];
+		}
+
+		inline Frame& push()
+		{
+			if ( depth == frames.size() ) frames.resize( 2*depth );
+			return frames[depth++];
+		}
+		inline const Frame& top() const { return frames[depth-1]; }
+		inline void pop() { --depth; }
+
+		void load( PmuSnapshot& snap )
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for ( auto& c: cells )
+			{
+				PmuStats& out = snap[c.first];
+				out.calls += c.second.calls.load(std::memory_order_relaxed);
+				for ( unsigned e = 0; e < pmu_n_events; ++e )
+					out.events[e] += c.second.events[e].load(std::memory_order_relaxed);
+			}
+		}
+	};
+
+	// Table of the calling thread, created on first use
+	inline ThreadTable& _table() { return tables.local(); }
+
+	PerThread<ThreadTable> tables;
+};
+
+}
+
+#endif
@@ -0,0 +1,143 @@
+#ifndef __SIGLOT_RT__
+#define __SIGLOT_RT__
+
+#include "siglot.h"
+
+#include <cstddef>
+#include <cstring>
+#include <sys/mman.h>
+
+//=============================================
+// @filename     siglot_rt.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Hard real-time profile.
+ *
+ * A RtSignal dispatches from a fixed-size table of subscribers, allocated,
+ * touched and locked in RAM at construction. Its invoke() does not allocate,
+ * lock, or make system calls, and runs in bounded time: at most "capacity"
+ * callbacks, plus a copy of at most "capacity" pointers when the subscribers
+ * changed since the previous invoke. The worst case is therefore set by the
+ * capacity and by the callbacks themselves.
+ *
+ * Subscriptions use the usual Slot interface, and should be made outside of
+ * the real-time section (they allocate). Probes are not fired by RtSignal,
+ * since they may allocate or lock.
+ *
+ * Typical setup of a control thread:
+ *     rt_lock_memory();          // no page faults afterwards
+ *     rt_prefault_stack();
+ *     RtSignal<State> signal(16); // subscribe Slots, then loop on invoke()
+ *
+ * NOTE:
+ * Calling invoke() through a reference to Signal uses the regular dispatch.
+ * Subscribing more Slots than the capacity is a configuration error: only
+ * the first "capacity" Slots are called, and overflow() returns true.
+ */
+
+// Lock all current and future pages of the process in RAM.
+// Requires CAP_IPC_LOCK, or a sufficient RLIMIT_MEMLOCK.
+inline bool rt_lock_memory() { return mlockall( MCL_CURRENT | MCL_FUTURE ) == 0; }
+
+// Touch the stack ahead of time, so that the real-time loop never faults on it
+template <size_t bytes = 64*1024>
+void rt_prefault_stack()
+{
+	unsigned char stack[bytes];
+	memset( stack, 0, bytes );
+	__asm__ __volatile__( "" :: "r"(stack) : "memory" ); // keep the writes
+}
+
+
+
+/**
+ * Signal with wait-free, bounded dispatch.
+ */
+template <typename data_type = VoidData>
+class RtSignal
+	: public Signal<data_type>
+{
+public:
+
+	typedef RtSignal<data_type> self;
+	typedef typename SlotSet<data_type>::slot_ptr slot_ptr;
+
+	explicit RtSignal( unsigned capacity = 64 )
+		: table(nullptr), n_slots(0), n_table(capacity), synced(0),
+		  is_locked(false), is_overflow(false)
+	{
+		bytes = (capacity ? capacity : 1) * sizeof(slot_ptr);
+		void *p = mmap( nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0 );
+		if ( p == MAP_FAILED ) { n_table = 0; return; }
+
+		memset( p, 0, bytes );
+		is_locked = mlock( p, bytes ) == 0;
+		table = static_cast<slot_ptr*>(p);
+	}
+
+	~RtSignal()
+	{
+		if ( table )
+		{
+			if ( is_locked ) munlock( table, bytes );
+			munmap( table, bytes );
+		}
+	}
+
+	// The table is not shared between copies
+	RtSignal( const self& ) = delete;
+	self& operator= ( const self& ) = delete;
+
+	// Maximum number of subscribers called
+	inline unsigned capacity() const { return n_table; }
+
+	// Is the table locked in RAM?
+	inline bool locked() const { return is_locked; }
+
+	// Were there more subscribers than the capacity at the last update?
+	inline bool overflow() const { return is_overflow; }
+
+	// Update the table with the current subscribers (done by invoke if needed);
+	// stops after the first "capacity" subscribers
+	void sync() const
+	{
+		unsigned i = 0;
+		if ( n_table ) this->slots.each_while( [&]( ListenerCore *slot ) {
+			table[i++] = static_cast<slot_ptr>(slot);
+			return i < n_table;
+		});
+		n_slots     = i;
+		is_overflow = this->count() > n_table;
+		synced      = this->revision();
+	}
+
+	// Trigger the signal from the preallocated table
+	inline void invoke() const
+	{
+		if ( synced != this->revision() ) sync();
+		for ( unsigned i = 0; i < n_slots; ++i )
+			this->_call( table[i], this->data );
+	}
+
+private:
+
+	slot_ptr *table;
+	size_t bytes;
+	mutable unsigned n_slots;
+	unsigned n_table;
+	mutable unsigned long synced;
+	bool is_locked;
+	mutable bool is_overflow;
+};
+
+}
+
+#endif
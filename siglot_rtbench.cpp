@@ -0,0 +1,137 @@
+#include "siglot_rt.h"
+#include "siglot_stats.h"
+#include <chrono>
+#include <memory>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <sched.h>
+#include <sys/resource.h>
+
+using namespace std;
+using namespace siglot;
+
+//=============================================
+// Jitter harness for the real-time profile (siglot_rt.h).
+//
+// Locks memory, switches to SCHED_FIFO and pins the thread when permitted,
+// then times each of "emissions" invokes of a RtSignal with "subscribers"
+// Slots. It reports the distribution of invoke durations (log-linear
+// histogram, 12.5% precision) with the exact minimum and maximum, and the
+// page faults and context switches which happened during the run.
+//
+// Usage: siglot_rtbench [emissions=100000000] [subscribers=8] [cpu=-1]
+//=============================================
+
+
+
+typedef chrono::steady_clock rt_clock;
+
+inline uint64_t now_ns()
+{
+    return chrono::duration_cast<chrono::nanoseconds>( rt_clock::now().time_since_epoch() ).count();
+}
+
+/**
+ * Callbacks do a constant amount of work, so that the variations measured
+ * come from the dispatch and the system.
+ */
+volatile uint64_t sink = 0;
+void callback( const uint64_t& x ) { sink = sink + x; }
+
+/**
+ * Distribution of durations with exact extremes.
+ */
+struct Jitter
+{
+    Histogram hist;
+    uint64_t min;
+
+    Jitter(): min(UINT64_MAX) {}
+
+    inline void record( uint64_t ns )
+    {
+        hist.record(ns);
+        if ( ns < min ) min = ns;
+    }
+
+    void print( const char *name ) const
+    {
+        cout << name << ": n " << hist.total << ", min " << min << ", p50 " << hist.percentile(.5)
+             << ", p99 " << hist.percentile(.99) << ", p99.99 " << hist.percentile(.9999)
+             << ", max " << hist.max << ", jitter " << hist.max - min << " (ns)" << endl;
+    }
+};
+
+
+
+    /********************     **********     ********************/
+    /********************     **********     ********************/
+
+
+
+int main( int argc, char *argv[] )
+{
+    const uint64_t emissions   = argc > 1 ? strtoull( argv[1], nullptr, 10 ) : 100000000;
+    const unsigned subscribers = argc > 2 ? atoi(argv[2]) : 8;
+    const int cpu              = argc > 3 ? atoi(argv[3]) : -1;
+
+    /**
+     * Real-time setup; each step may require privileges, and is reported.
+     */
+    cout << "mlockall: " << (rt_lock_memory() ? "yes" : "no") << endl;
+
+    sched_param param = {};
+    param.sched_priority = sched_get_priority_max(SCHED_FIFO);
+    cout << "SCHED_FIFO: " << (sched_setscheduler( 0, SCHED_FIFO, &param ) == 0 ? "yes" : "no") << endl;
+
+    if ( cpu >= 0 )
+    {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu, &set);
+        cout << "pinned to cpu " << cpu << ": "
+             << (sched_setaffinity( 0, sizeof(set), &set ) == 0 ? "yes" : "no") << endl;
+    }
+    rt_prefault_stack();
+
+    RtSignal<uint64_t> signal( subscribers );
+    unique_ptr< Slot<uint64_t>[] > slots( new Slot<uint64_t>[subscribers] );
+    for ( unsigned i = 0; i < subscribers; ++i )
+    {
+        slots[i].bind( &callback );
+        slots[i].subscribe( &signal );
+    }
+    cout << "table locked: " << (signal.locked() ? "yes" : "no") << endl;
+
+    /**
+     * Timer overhead, then the timed emissions (after a warm-up).
+     */
+    Jitter timer, dispatch;
+    for ( uint64_t i = 0; i < emissions / 10 + 1; ++i )
+    {
+        uint64_t t0 = now_ns();
+        timer.record( now_ns() - t0 );
+    }
+    for ( uint64_t i = 0; i < 100000; ++i ) signal.invoke();
+
+    rusage before, after;
+    getrusage( RUSAGE_THREAD, &before );
+
+    for ( uint64_t i = 0; i < emissions; ++i )
+    {
+        signal.data = i;
+        uint64_t t0 = now_ns();
+        signal.invoke();
+        dispatch.record( now_ns() - t0 );
+    }
+
+    getrusage( RUSAGE_THREAD, &after );
+
+    timer.print( "timer" );
+    dispatch.print( "invoke" );
+    cout << "during run: " << after.ru_minflt - before.ru_minflt << " minor faults, "
+         << after.ru_majflt - before.ru_majflt << " major faults, "
+         << after.ru_nvcsw - before.ru_nvcsw << " voluntary and "
+         << after.ru_nivcsw - before.ru_nivcsw << " involuntary context switches" << endl;
+}
@@ -0,0 +1,306 @@
+#ifndef __SIGLOT_SHM__
+#define __SIGLOT_SHM__
+
+#include "siglot.h"
+#include "siglot_clock.h"
+#include "siglot_perthread.h"
+
+#include <new>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+//=============================================
+// @filename     siglot_shm.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+static_assert( ATOMIC_LLONG_LOCK_FREE == 2,
+	"Shared statistics require lock-free 64 bits atomics." );
+
+/**
+ * Layout of the shared statistics segment:
+ *
+ *     [ ShmHeader ][ ShmRecord ] x capacity
+ *
+ * Records form an open-addressing table keyed by Signal address; a record
+ * is in use once its key is non-zero, and is never released afterwards.
+ * Each record occupies its own cache lines, so Signals updated from different
+ * threads do not contend, and readers never write to the segment.
+ */
+struct alignas(64) ShmHeader
+{
+	static const uint64_t magic_value = 0x746f6c676973ull; // "siglot"
+	static const uint32_t version_value = 2;
+
+	uint64_t magic;
+	uint32_t version;
+	uint32_t capacity;
+	uint64_t start;    // ns, see clock_now
+	std::atomic<uint64_t> overflow; // emits of Signals that did not fit
+};
+
+struct alignas(64) ShmRecord
+{
+	static const unsigned name_size = 64;
+
+	std::atomic<uint64_t> key;          // Signal address, 0 if unused
+	std::atomic<uint64_t> emits;
+	std::atomic<uint64_t> deliveries;   // sum of subscriber counts over all emits
+	std::atomic<uint64_t> drops;        // events discarded before delivery
+	std::atomic<uint64_t> queue_depth;  // events waiting for delivery
+	std::atomic<uint64_t> slowest_slot; // address of the slowest Slot so far
+	std::atomic<uint64_t> slowest_ns;   // and the duration of its callback
+
+	// Label (nul-terminated), written under a sequence lock: the version is
+	// odd while it is written
+	std::atomic<uint64_t> name_version;
+	std::atomic<uint64_t> name[ name_size / 8 ];
+};
+
+static_assert( sizeof(ShmHeader) == 64 && sizeof(ShmRecord) == 128,
+	"Shared statistics records must fill whole cache lines." );
+
+
+
+/**
+ * Read-only view of a segment, for monitoring tools.
+ */
+class ShmView
+{
+public:
+
+	ShmView(): header(nullptr), bytes(0) {}
+	~ShmView() { close(); }
+
+	ShmView( const ShmView& other ) = delete;
+	ShmView& operator= ( const ShmView& other ) = delete;
+
+	bool open( const std::string& name )
+	{
+		close();
+		int fd = ::shm_open( name.c_str(), O_RDONLY, 0 );
+		if ( fd < 0 ) return false;
+
+		struct { uint64_t magic; uint32_t version, capacity; } h;
+		bool ok = ::pread( fd, &h, sizeof(h), 0 ) == sizeof(h)
+			&& h.magic == ShmHeader::magic_value && h.version == ShmHeader::version_value;
+		// The segment must hold all the records its header announces
+		struct stat st;
+		ok = ok && h.capacity > 0 && ::fstat( fd, &st ) == 0
+			&& uint64_t(st.st_size) >= sizeof(ShmHeader) + uint64_t(h.capacity) * sizeof(ShmRecord);
+		if ( ok )
+		{
+			bytes = sizeof(ShmHeader) + size_t(h.capacity) * sizeof(ShmRecord);
+			void *p = ::mmap( nullptr, bytes, PROT_READ, MAP_SHARED, fd, 0 );
+			ok = p != MAP_FAILED;
+			header = ok ? static_cast<const ShmHeader*>(p) : nullptr;
+		}
+		::close(fd);
+		return ok;
+	}
+
+	void close()
+	{
+		if ( header ) ::munmap( const_cast<ShmHeader*>(header), bytes );
+		header = nullptr;
+	}
+
+	inline bool is_open() const { return header; }
+	inline unsigned capacity() const { return header ? header->capacity : 0; }
+	inline const ShmHeader* head() const { return header; }
+
+	inline const ShmRecord& record( unsigned i ) const
+	{
+		return reinterpret_cast<const ShmRecord*>( header + 1 )[i];
+	}
+
+	// Label of a record (empty if none, or if it keeps changing)
+	std::string name( unsigned i ) const
+	{
+		const ShmRecord& r = record(i);
+		char buf[ ShmRecord::name_size + 1 ] = {};
+
+		for ( unsigned attempt = 0; attempt < 100; ++attempt )
+		{
+			const uint64_t v = r.name_version.load(std::memory_order_acquire);
+			if ( v & 1 ) continue;
+
+			uint64_t words[ ShmRecord::name_size / 8 ];
+			for ( unsigned k = 0; k < ShmRecord::name_size / 8; ++k )
+				words[k] = r.name[k].load(std::memory_order_relaxed);
+
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if ( r.name_version.load(std::memory_order_relaxed) != v ) continue;
+
+			std::memcpy( buf, words, ShmRecord::name_size );
+			return std::string(buf);
+		}
+		return std::string();
+	}
+
+protected:
+
+	const ShmHeader *header;
+	size_t bytes;
+};
+
+
+
+/**
+ * Probe publishing per-Signal counters into a named shared-memory segment
+ * (see siglot.h, SIGLOT_INSTRUMENT), eg for the siglot_top tool.
+ *
+ * Updates are relaxed atomic increments on the Signal's record, found by
+ * hashing its address; no lock is taken. The segment is removed when the
+ * probe is destroyed.
+ */
+class ShmStatsProbe
+	: public Probe
+{
+public:
+
+	ShmStatsProbe( const std::string& name = "/siglot", unsigned capacity = 1024 )
+		: segment(name), header(nullptr), records(nullptr), bytes(0)
+	{
+		capacity = capacity ? capacity : 1;
+		bytes = sizeof(ShmHeader) + capacity * sizeof(ShmRecord);
+
+		int fd = ::shm_open( name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+		if ( fd < 0 ) return;
+
+		void *p = ::ftruncate( fd, bytes ) == 0
+			? ::mmap( nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0 ) : MAP_FAILED;
+		::close(fd);
+		if ( p == MAP_FAILED ) { ::shm_unlink( name.c_str() ); return; }
+
+		// The segment is zero-filled, which is a valid state for the atomics
+		header = new (p) ShmHeader();
+		header->capacity = capacity;
+		header->start    = clock_now();
+		header->overflow.store( 0 );
+		records = reinterpret_cast<ShmRecord*>( header + 1 );
+		for ( unsigned i = 0; i < capacity; ++i ) new (records + i) ShmRecord();
+		header->version  = ShmHeader::version_value;
+		header->magic    = ShmHeader::magic_value;
+	}
+
+	~ShmStatsProbe()
+	{
+		if ( !header ) return;
+		::munmap( header, bytes );
+		::shm_unlink( segment.c_str() );
+	}
+
+	ShmStatsProbe( const ShmStatsProbe& other ) = delete;
+	ShmStatsProbe& operator= ( const ShmStatsProbe& other ) = delete;
+
+	// True if the segment was created successfully
+	inline bool is_open() const { return header; }
+
+	// Label a Signal in the monitoring output (at most 63 characters; not
+	// from several threads at once for the same Signal)
+	void name( const void *signal, const std::string& label )
+	{
+		ShmRecord *r = _record( signal );
+		if ( !r ) return;
+
+		uint64_t words[ ShmRecord::name_size / 8 ] = {};
+		std::memcpy( words, label.c_str(), std::min<size_t>( label.size(), ShmRecord::name_size - 1 ) );
+
+		const uint64_t v = r->name_version.load(std::memory_order_relaxed);
+		r->name_version.store( v + 1, std::memory_order_relaxed );
+		std::atomic_thread_fence(std::memory_order_release);
+		for ( unsigned k = 0; k < ShmRecord::name_size / 8; ++k )
+			r->name[k].store( words[k], std::memory_order_relaxed );
+		r->name_version.store( v + 2, std::memory_order_release );
+	}
+
+	// Queue state of a Signal with deferred delivery (reported by the
+	// partitioned and sequenced Signals, and by bridge writers)
+	void queue( const void *signal, uint64_t depth, uint64_t dropped )
+	{
+		ShmRecord *r = _record( signal );
+		if ( !r ) return;
+		r->queue_depth.store( depth, std::memory_order_relaxed );
+		if ( dropped ) r->drops.fetch_add( dropped, std::memory_order_relaxed );
+	}
+
+	void emit_begin( const void *signal, unsigned fanout )
+	{
+		ShmRecord *r = _record( signal );
+		if ( !r )
+		{
+			if ( header ) header->overflow.fetch_add( 1, std::memory_order_relaxed );
+			return;
+		}
+		r->emits.fetch_add( 1, std::memory_order_relaxed );
+		r->deliveries.fetch_add( fanout, std::memory_order_relaxed );
+	}
+
+	void slot_begin( const void*, const void* ) { _starts().push_back( clock_now() ); }
+
+	void slot_end( const void *signal, const void *slot )
+	{
+		std::vector<uint64_t>& starts = _starts();
+		if ( starts.empty() ) return;
+
+		uint64_t d = clock_now() - starts.back();
+		starts.pop_back();
+
+		ShmRecord *r = _record( signal );
+		if ( r && d > r->slowest_ns.load(std::memory_order_relaxed) )
+		{
+			r->slowest_ns.store( d, std::memory_order_relaxed );
+			r->slowest_slot.store( reinterpret_cast<uintptr_t>(slot), std::memory_order_relaxed );
+		}
+	}
+
+protected:
+
+	// Start times of the callbacks in progress on this thread (can be nested)
+	inline std::vector<uint64_t>& _starts() { return thread_starts.local(); }
+
+	// Find or claim the record of a Signal (linear probing)
+	ShmRecord* _record( const void *signal )
+	{
+		if ( !header ) return nullptr;
+
+		const uint64_t key = reinterpret_cast<uintptr_t>(signal);
+		const unsigned n = header->capacity;
+		unsigned i = ((key >> 4) * 0x9E3779B97F4A7C15ull) >> 32;
+
+		for ( unsigned k = 0; k < n; ++k )
+		{
+			ShmRecord& r = records[ (i + k) % n ];
+			uint64_t cur = r.key.load(std::memory_order_acquire);
+			if ( cur == key ) return &r;
+			if ( cur == 0 && r.key.compare_exchange_strong( cur, key ) ) return &r;
+			if ( cur == key ) return &r;
+		}
+		return nullptr;
+	}
+
+	std::string segment;
+	ShmHeader *header;
+	ShmRecord *records;
+	size_t bytes;
+	PerThread< std::vector<uint64_t> > thread_starts;
+};
+
+}
+
+#endif
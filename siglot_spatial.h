@@ -0,0 +1,243 @@
+#ifndef __SIGLOT_SPATIAL__
+#define __SIGLOT_SPATIAL__
+
+#include "siglot.h"
+
+#include <cmath>
+#include <vector>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+//=============================================
+// @filename     siglot_spatial.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Axis-aligned region of interest, [x0,x1) x [y0,y1).
+ */
+struct Region
+{
+	double x0, y0, x1, y1;
+
+	inline bool contains( double x, double y ) const
+		{ return x >= x0 && x < x1 && y >= y0 && y < y1; }
+};
+
+
+
+/**
+ * Spatial interest routing.
+ *
+ * Slots subscribe to a SpatialSignal with a region of interest, and events
+ * are emitted at a position with invoke(x,y): only the Slots whose region
+ * contains the position are called. Regions are indexed in a sparse uniform
+ * grid, so an emission only looks at the Slots of one cell; moving a region
+ * only updates the cells it leaves and enters.
+ *
+ * - subscribe( slot, region ): subscribe with a region of interest
+ * - move( slot, region )     : change the region of a subscribed Slot
+ * - unsubscribe( slot )      : incremental removal
+ * - invoke( x, y )           : emit at a position
+ * - invoke()                 : broadcast to all subscribers
+ *
+ * Slots subscribed without a region (with slot.subscribe) receive every
+ * event. Callbacks may move, subscribe or unsubscribe Slots: an emission
+ * calls the Slots interested when it starts, which are still subscribed and
+ * interested when their turn comes. Slots which unsubscribe by themselves (or are destroyed) are
+ * removed from the grid at the next emission, in linear time; call
+ * unsubscribe on the SpatialSignal to avoid this with many subscribers.
+ *
+ * Cells should be about the size of a typical region: larger cells mean more
+ * candidates per emission, smaller cells more updates per move.
+ */
+template <typename data_type = VoidData>
+class SpatialSignal
+	: public Signal<data_type>
+{
+public:
+
+	typedef SpatialSignal<data_type> self;
+	typedef ListenerInterface<data_type> listener_type;
+
+	explicit SpatialSignal( double cell_size = 1.0 )
+		: cell(cell_size), known(0), depth(0) {}
+
+	// Subscribe a Slot, with a region of interest
+	void subscribe( listener_type& slot, const Region& r )
+	{
+		unsubscribe(slot);
+		slot.unsubscribe();
+		slot.subscribe(this);
+
+		Interest& in = interests[&slot];
+		in.region = r;
+		_cells( r, in );
+		_insert( &slot, in );
+		known = this->revision();
+	}
+
+	// Update the region of a subscribed Slot
+	void move( listener_type& slot, const Region& r )
+	{
+		_sync();
+		auto it = interests.find(&slot);
+		if ( it == interests.end() ) return;
+
+		Interest next = it->second;
+		next.region = r;
+		_cells( r, next );
+		if ( next.cx0 != it->second.cx0 || next.cy0 != it->second.cy0 ||
+		     next.cx1 != it->second.cx1 || next.cy1 != it->second.cy1 )
+		{
+			_remove( &slot, it->second );
+			_insert( &slot, next );
+		}
+		it->second = next;
+	}
+
+	// Unsubscribe a Slot, and remove its region from the index
+	void unsubscribe( listener_type& slot )
+	{
+		_sync();
+		if ( !this->slots.contains(&slot) ) return;
+
+		auto it = interests.find(&slot);
+		if ( it != interests.end() )
+		{
+			_remove( &slot, it->second );
+			interests.erase(it);
+		}
+		else
+		{
+			auto g = std::find( global.begin(), global.end(), &slot );
+			if ( g != global.end() ) global.erase(g);
+		}
+
+		slot.unsubscribe();
+		known = this->revision();
+	}
+
+	// Number of Slots with a region of interest
+	inline unsigned regions() const { return interests.size(); }
+
+	// Broadcast to all subscribers
+	using Signal<data_type>::invoke;
+
+	// Trigger the Slots interested in a position
+	void invoke( double x, double y )
+	{
+		_sync();
+
+		// Callbacks may move or unsubscribe Slots, which changes the grid:
+		// the candidates are copied first, and checked again before each call
+		if ( depth == scratch.size() ) scratch.emplace_back();
+		std::vector<ListenerCore*>& candidates = scratch[depth];
+		candidates.clear();
+
+		auto c = grid.find( _key( _coord(x), _coord(y) ) );
+		if ( c != grid.end() )
+			for ( auto slot: c->second )
+				if ( _wants( slot, x, y ) ) candidates.push_back(slot);
+		candidates.insert( candidates.end(), global.begin(), global.end() );
+
+		SIGLOT_PROBE( emit_begin, this, candidates.size() );
+		++depth;
+		for ( size_t i = 0; i < scratch[depth-1].size(); ++i )
+		{
+			ListenerCore *slot = scratch[depth-1][i];
+			if ( !this->slots.contains(slot) || !_wants( slot, x, y ) ) continue;
+
+			SIGLOT_PROBE( slot_begin, this, slot );
+			this->_call( slot, this->data );
+			SIGLOT_PROBE( slot_end, this, slot );
+		}
+		--depth;
+		SIGLOT_PROBE( emit_end, this );
+	}
+
+protected:
+
+	// Region and range of cells covered
+	struct Interest
+	{
+		Region region;
+		int64_t cx0, cy0, cx1, cy1;
+	};
+
+	double cell;
+	unsigned long known;
+	unsigned depth;
+	std::vector< std::vector<ListenerCore*> > scratch; // candidates, per nested emission
+	std::unordered_map< uint64_t, std::vector<ListenerCore*> > grid;
+	std::unordered_map< ListenerCore*, Interest > interests;
+	std::vector<ListenerCore*> global;
+
+	// Does a Slot want an event at a given position? (Slots without a region
+	// want all of them)
+	inline bool _wants( ListenerCore *slot, double x, double y ) const
+	{
+		auto it = interests.find(slot);
+		return it == interests.end() || it->second.region.contains(x,y);
+	}
+
+	inline int64_t _coord( double v ) const { return std::floor( v / cell ); }
+	inline static uint64_t _key( int64_t cx, int64_t cy )
+		{ return (uint64_t(uint32_t(cx)) << 32) | uint32_t(cy); }
+
+	void _cells( const Region& r, Interest& in ) const
+	{
+		in.cx0 = _coord(r.x0); in.cx1 = _coord(r.x1);
+		in.cy0 = _coord(r.y0); in.cy1 = _coord(r.y1);
+	}
+
+	void _insert( ListenerCore *slot, const Interest& in )
+	{
+		for ( int64_t cx = in.cx0; cx <= in.cx1; ++cx )
+		for ( int64_t cy = in.cy0; cy <= in.cy1; ++cy )
+			grid[ _key(cx,cy) ].push_back(slot);
+	}
+
+	void _remove( ListenerCore *slot, const Interest& in )
+	{
+		for ( int64_t cx = in.cx0; cx <= in.cx1; ++cx )
+		for ( int64_t cy = in.cy0; cy <= in.cy1; ++cy )
+		{
+			auto c = grid.find( _key(cx,cy) );
+			if ( c == grid.end() ) continue;
+
+			std::vector<ListenerCore*>& v = c->second;
+			auto it = std::find( v.begin(), v.end(), slot );
+			if ( it != v.end() ) { *it = v.back(); v.pop_back(); }
+			if ( v.empty() ) grid.erase(c);
+		}
+	}
+
+	// Reconcile the index with subscriptions changed outside of this class
+	void _sync()
+	{
+		if ( known == this->revision() ) return;
+
+		for ( auto it = interests.begin(); it != interests.end(); )
+			if ( this->slots.contains(it->first) ) ++it;
+			else { _remove( it->first, it->second ); it = interests.erase(it); }
+
+		global.clear();
+		this->slots.each( [this]( ListenerCore *slot ) {
+			if ( !interests.count(slot) ) global.push_back(slot);
+		});
+
+		known = this->revision();
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,393 @@
+#ifndef __SIGLOT_STATS__
+#define __SIGLOT_STATS__
+
+#include "siglot.h"
+#include "siglot_clock.h"
+#include "siglot_perthread.h"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <utility>
+#include <unordered_map>
+
+//=============================================
+// @filename     siglot_stats.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Log-linear histogram of nanosecond durations (HDR-style).
+ * Values below 8 are counted exactly; above that, each power of two is split
+ * into 8 sub-buckets, which bounds the relative error to 12.5% over the full
+ * 64 bits range with a fixed footprint of 496 buckets.
+ */
+struct Histogram
+{
+	static const unsigned sub_bits  = 3;
+	static const unsigned sub_count = 1u << sub_bits;
+	static const unsigned n_buckets = (64 - sub_bits + 1) * sub_count;
+
+	uint64_t buckets[n_buckets];
+	uint64_t total;
+	uint64_t sum;
+	uint64_t max;
+
+	Histogram() { clear(); }
+
+	void clear()
+	{
+		for ( unsigned i = 0; i < n_buckets; ++i ) buckets[i] = 0;
+		total = sum = max = 0;
+	}
+
+	// Bucket containing a given value
+	inline static unsigned index( uint64_t v )
+	{
+		if ( v < sub_count ) return v;
+		unsigned shift = 63 - __builtin_clzll(v) - sub_bits;
+		return (shift + 1) * sub_count + ((v >> shift) & (sub_count - 1));
+	}
+
+	// Smallest value counted in a given bucket
+	inline static uint64_t lower( unsigned i )
+	{
+		if ( i < sub_count ) return i;
+		unsigned shift = i / sub_count - 1;
+		return uint64_t(sub_count + i % sub_count) << shift;
+	}
+
+	inline void record( uint64_t v )
+	{
+		++buckets[index(v)]; ++total; sum += v;
+		if ( v > max ) max = v;
+	}
+
+	void merge( const Histogram& other )
+	{
+		for ( unsigned i = 0; i < n_buckets; ++i ) buckets[i] += other.buckets[i];
+		total += other.total;
+		sum   += other.sum;
+		if ( other.max > max ) max = other.max;
+	}
+
+	inline double mean() const { return total ? double(sum) / total : 0.0; }
+
+	// Lower bound of the bucket containing the q-th quantile (q in [0,1])
+	uint64_t percentile( double q ) const
+	{
+		uint64_t rank = q * total, seen = 0;
+		for ( unsigned i = 0; i < n_buckets; ++i )
+			if ( (seen += buckets[i]) > rank ) return lower(i);
+		return max;
+	}
+};
+
+
+
+/**
+ * Statistics reported for each Signal and each Slot.
+ * Event counts are exact; durations only account for sampled emissions.
+ */
+struct SignalStats
+{
+	uint64_t emits;
+	uint64_t fanout;    // sum of subscriber counts over all emits
+	Histogram invoke;   // duration of sampled invoke() calls, in ns
+
+	SignalStats(): emits(0), fanout(0) {}
+
+	void merge( const SignalStats& other )
+	{
+		emits  += other.emits;
+		fanout += other.fanout;
+		invoke.merge( other.invoke );
+	}
+
+	inline double mean_fanout() const { return emits ? double(fanout) / emits : 0.0; }
+};
+
+struct SlotStats
+{
+	uint64_t calls;
+	Histogram callback; // duration of sampled callbacks, in ns
+
+	SlotStats(): calls(0) {}
+
+	void merge( const SlotStats& other )
+	{
+		calls += other.calls;
+		callback.merge( other.callback );
+	}
+};
+
+/**
+ * Merged view of the statistics at a given time.
+ * Snapshots from several probes (or processes, if the keys are meaningful
+ * there) can be combined with merge; emit rates follow from the difference
+ * of two snapshots' emit counts over their "elapsed" times.
+ */
+struct StatsSnapshot
+{
+	// Forwarding edge: a Slot invoking a Signal from its callback
+	typedef std::pair<const void*, const void*> edge_type;
+
+	double elapsed; // seconds since the probe was created
+	std::map<const void*, SignalStats> signals;
+	std::map<const void*, SlotStats> slots;
+	std::map<edge_type, uint64_t> forwards;
+
+	StatsSnapshot(): elapsed(0) {}
+
+	void merge( const StatsSnapshot& other )
+	{
+		if ( other.elapsed > elapsed ) elapsed = other.elapsed;
+		for ( auto& s: other.signals ) signals[s.first].merge( s.second );
+		for ( auto& s: other.slots ) slots[s.first].merge( s.second );
+		for ( auto& f: other.forwards ) forwards[f.first] += f.second;
+	}
+
+	inline double emit_rate( const void *signal ) const
+	{
+		auto it = signals.find(signal);
+		return it == signals.end() || elapsed <= 0 ? 0.0 : it->second.emits / elapsed;
+	}
+};
+
+
+
+/**
+ * Probe recording SignalStats and SlotStats (see siglot.h, SIGLOT_INSTRUMENT).
+ *
+ * Each thread records into its own tables, with relaxed atomic stores that
+ * a snapshot can read concurrently: the hot path takes no lock and shares no
+ * cache line with other threads. A thread only locks its own table the first
+ * time it meets a Signal or Slot. Timing is restricted to one in every
+ * "sample_every" emissions (per thread), to bound the overhead.
+ */
+class StatsProbe
+	: public Probe
+{
+public:
+
+	StatsProbe( unsigned sample_every = 1 )
+		: sample_every(sample_every ? sample_every : 1),
+		  start(clock_now()) {}
+
+	StatsProbe( const StatsProbe& other ) = delete;
+	StatsProbe& operator= ( const StatsProbe& other ) = delete;
+
+	// Merge the tables of all threads (including exited ones)
+	StatsSnapshot snapshot() const
+	{
+		StatsSnapshot snap;
+		snap.elapsed = (clock_now() - start) * 1e-9;
+
+		tables.each( [&snap]( ThreadTable& t ){ t.load( snap ); } );
+		return snap;
+	}
+
+	void emit_begin( const void *signal, unsigned fanout )
+	{
+		ThreadTable& t = _table();
+		SignalCell& c = t.signal( signal );
+		_add( c.emits, 1 );
+		_add( c.fanout, fanout );
+
+		// Emitted from within a callback
+		if ( t.depth && t.top().slot ) _add( t.forward( t.top().slot, signal ), 1 );
+
+		Frame& f = t.push();
+		f.slot = nullptr;
+		f.sampled = (++t.tick % sample_every) == 0;
+		if ( f.sampled ) f.emit_start = clock_now();
+	}
+
+	void emit_end( const void *signal )
+	{
+		ThreadTable& t = _table();
+		Frame& f = t.top();
+		if ( f.sampled ) t.signal( signal ).invoke.record( clock_now() - f.emit_start );
+		t.pop();
+	}
+
+	void slot_begin( const void*, const void *slot )
+	{
+		ThreadTable& t = _table();
+		_add( t.slot( slot ).calls, 1 );
+
+		Frame& f = t.top();
+		f.slot = slot;
+		if ( f.sampled ) f.slot_start = clock_now();
+	}
+
+	void slot_end( const void*, const void *slot )
+	{
+		ThreadTable& t = _table();
+		Frame& f = t.top();
+		if ( f.sampled ) t.slot( slot ).callback.record( clock_now() - f.slot_start );
+		f.slot = nullptr;
+	}
+
+protected:
+
+	typedef std::atomic<uint64_t> counter;
+
+	// Single-writer increment: no read-modify-write instruction needed
+	inline static void _add( counter& c, uint64_t n )
+	{
+		c.store( c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed );
+	}
+
+
+	// Histogram written by one thread while snapshots read it
+	struct AtomicHistogram
+	{
+		counter buckets[Histogram::n_buckets];
+		counter total, sum, max;
+
+		AtomicHistogram(): total(0), sum(0), max(0)
+		{
+			for ( auto& b: buckets ) b.store( 0, std::memory_order_relaxed );
+		}
+
+		inline void record( uint64_t v )
+		{
+			_add( buckets[Histogram::index(v)], 1 );
+			_add( total, 1 ); _add( sum, v );
+			if ( v > max.load(std::memory_order_relaxed) )
+				max.store( v, std::memory_order_relaxed );
+		}
+
+		void load( Histogram& h ) const
+		{
+			Histogram tmp;
+			for ( unsigned i = 0; i < Histogram::n_buckets; ++i )
+				tmp.buckets[i] = buckets[i].load(std::memory_order_relaxed);
+			tmp.total = total.load(std::memory_order_relaxed);
+			tmp.sum   = sum.load(std::memory_order_relaxed);
+			tmp.max   = max.load(std::memory_order_relaxed);
+			h.merge(tmp);
+		}
+	};
+
+	struct SignalCell
+	{
+		counter emits, fanout;
+		AtomicHistogram invoke;
+		SignalCell(): emits(0), fanout(0) {}
+	};
+
+	struct SlotCell
+	{
+		counter calls;
+		AtomicHistogram callback;
+		SlotCell(): calls(0) {}
+	};
+
+	struct EdgeHash
+	{
+		inline size_t operator() ( const StatsSnapshot::edge_type& e ) const
+		{
+			return std::hash<const void*>()(e.first) * 31 + std::hash<const void*>()(e.second);
+		}
+	};
+
+	// Start times of the emissions in progress (invoke can be nested)
+	struct Frame
+	{
+		const void *slot; // callback in progress, if any
+		bool sampled;
+		uint64_t emit_start, slot_start;
+	};
+
+	// Per-thread tables; nodes of unordered_maps are never relocated
+	struct ThreadTable
+	{
+		std::mutex mutex;
+		std::unordered_map<const void*, SignalCell> signals;
+		std::unordered_map<const void*, SlotCell> slots;
+		std::unordered_map<StatsSnapshot::edge_type, counter, EdgeHash> forwards;
+		std::vector<Frame> frames;
+		unsigned depth, tick;
+
+		ThreadTable(): frames(16), depth(0), tick(0) {}
+
+		SignalCell& signal( const void *k )
+		{
+			auto it = signals.find(k);
+			if ( it != signals.end() ) return it->second;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			return signals[k];
+		}
+
+		SlotCell& slot( const void *k )
+		{
+			auto it = slots.find(k);
+			if ( it != slots.end() ) return it->second;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			return slots[k];
+		}
+
+		counter& forward( const void *slot, const void *signal )
+		{
+			StatsSnapshot::edge_type k( slot, signal );
+			auto it = forwards.find(k);
+			if ( it != forwards.end() ) return it->second;
+
+			std::lock_guard<std::mutex> lock(mutex);
+			return forwards[k];
+		}
+
+		inline Frame& push()
+		{
+			if ( depth == frames.size() ) frames.resize( 2*depth );
+			return frames[depth++];
+		}
+		inline Frame& top() { return frames[depth-1]; }
+		inline void pop() { --depth; }
+
+		void load( StatsSnapshot& snap )
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			for ( auto& s: signals )
+			{
+				SignalStats& out = snap.signals[s.first];
+				out.emits  += s.second.emits.load(std::memory_order_relaxed);
+				out.fanout += s.second.fanout.load(std::memory_order_relaxed);
+				s.second.invoke.load( out.invoke );
+			}
+			for ( auto& s: slots )
+			{
+				SlotStats& out = snap.slots[s.first];
+				out.calls += s.second.calls.load(std::memory_order_relaxed);
+				s.second.callback.load( out.callback );
+			}
+			for ( auto& f: forwards )
+				snap.forwards[f.first] += f.second.load(std::memory_order_relaxed);
+		}
+	};
+
+	// Table of the calling thread, created on first use
+	inline ThreadTable& _table() { return tables.local(); }
+
+	unsigned sample_every;
+	uint64_t start;
+	PerThread<ThreadTable> tables;
+};
+
+}
+
+#endif
@@ -0,0 +1,754 @@
+#ifndef __SIGLOT_THREAD__
+#define __SIGLOT_THREAD__
+
+#include "siglot.h"
+#include "siglot_alloc.h"
+#include "siglot_clock.h"
+#include "siglot_perthread.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <cassert>
+#include <functional>
+#include <condition_variable>
+
+//=============================================
+// @filename     siglot_thread.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Queue of tasks executed by one thread.
+ *
+ * Any thread may post tasks; the owning thread runs them in order, either in
+ * a loop with run(), or from its own loop with poll(). A task is a function
+ * pointer applied to a target and a payload, both held by shared pointers, so
+ * that posting does not allocate beyond the queue itself.
+ *
+ * Tasks may also be scheduled at a time of the installed clock (see
+ * siglot_clock.h), and run after the tasks queued when they fall due. run()
+ * sleeps until the next deadline in real time; under a VirtualClock, drive
+ * the Dispatcher with poll() after moving the clock instead.
+ *
+ * Dispatchers are not copyable; they must outlive the tasks posted to them.
+ */
+class Dispatcher
+{
+public:
+
+	typedef void (*function_type)( void *target, const void *payload );
+
+	Dispatcher(): stopped(false) {}
+
+	Dispatcher( const Dispatcher& ) = delete;
+	Dispatcher& operator= ( const Dispatcher& ) = delete;
+
+	// Dispatcher of the calling thread, while it runs or polls one (or nullptr)
+	inline static Dispatcher* current() { return _current(); }
+
+	// Queue a task (from any thread)
+	void post( function_type f, std::shared_ptr<void> target, std::shared_ptr<const void> payload )
+	{
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_queue );
+			std::lock_guard<std::mutex> lock(mutex);
+			queue.push_back( Task{ f, std::move(target), std::move(payload) } );
+		}
+		ready.notify_one();
+	}
+
+	// Queue a task at a given time (ns, see clock_now), or after a delay
+	Timers::id_type post_at( uint64_t deadline, function_type f, std::shared_ptr<void> target, std::shared_ptr<const void> payload )
+	{
+		Timers::id_type id;
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_queue );
+			std::lock_guard<std::mutex> lock(mutex);
+			id = timers.at( deadline, f, std::move(target), std::move(payload) );
+		}
+		ready.notify_one();
+		return id;
+	}
+
+	inline Timers::id_type post_after( uint64_t delay, function_type f, std::shared_ptr<void> target, std::shared_ptr<const void> payload )
+	{
+		return post_at( clock_now() + delay, f, std::move(target), std::move(payload) );
+	}
+
+	// Remove a scheduled task; returns false if it already ran
+	bool cancel( Timers::id_type id )
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return timers.cancel(id);
+	}
+
+	// Number of tasks waiting, and of scheduled tasks not due yet
+	size_t pending() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return queue.size();
+	}
+
+	size_t scheduled() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return timers.size();
+	}
+
+	// Run the tasks currently queued or due, and return their number
+	unsigned poll()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			_take( clock_now() );
+		}
+		return _run_batch();
+	}
+
+	// Run tasks as they come or fall due, until stop() is called and the
+	// queue is empty (tasks scheduled later are kept)
+	void run()
+	{
+		for ( ;; )
+		{
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				uint64_t now = clock_now();
+				while ( queue.empty() && timers.next() > now )
+				{
+					if ( stopped ) { stopped = false; return; }
+
+					if ( timers.empty() ) ready.wait(lock);
+					else ready.wait_for( lock, std::chrono::nanoseconds( timers.next() - now ) );
+					now = clock_now();
+				}
+				_take( now );
+			}
+			_run_batch();
+		}
+	}
+
+	// Make run() return once the queue is empty (from any thread)
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = true;
+		}
+		ready.notify_all();
+	}
+
+protected:
+
+	struct Task
+	{
+		function_type function;
+		std::shared_ptr<void> target;
+		std::shared_ptr<const void> payload;
+	};
+
+	mutable std::mutex mutex;
+	std::condition_variable ready;
+	std::vector<Task> queue, batch;
+	bool stopped;
+
+	Timers timers;
+	std::vector<Timers::Task> due;
+
+	inline static Dispatcher*& _current()
+	{
+		static thread_local Dispatcher *d = nullptr;
+		return d;
+	}
+
+	// Move the queued tasks, then those due, to the batch (locked)
+	void _take( uint64_t now )
+	{
+		batch.swap(queue);
+		if ( timers.take_due( now, due ) == 0 ) return;
+
+		for ( auto& t: due ) batch.push_back( Task{ t.function, std::move(t.target), std::move(t.payload) } );
+		due.clear();
+	}
+
+	unsigned _run_batch()
+	{
+		Dispatcher *previous = _current();
+		_current() = this;
+
+		const unsigned n = batch.size();
+		for ( auto& t: batch ) t.function( t.target.get(), t.payload.get() );
+		batch.clear();
+
+		_current() = previous;
+		return n;
+	}
+};
+
+
+
+/**
+ * Signal with subscribers on several threads.
+ *
+ * Subscribers are grouped by the Dispatcher of their thread: each group is a
+ * local Signal, to which Slots subscribe as usual (from the owning thread, or
+ * before it starts). An emission copies the data once into a shared payload,
+ * and posts a single task to each Dispatcher with a local Signal, which then
+ * calls its local Slots. Cross-thread traffic is one queue push per thread,
+ * rather than per subscriber.
+ *
+ * - local( d )  : local Signal of the subscribers running on Dispatcher d
+ * - invoke()    : emit the current data (from any thread)
+ * - invoke( x ) : emit a given value
+ * - threads()   : number of destination Dispatchers
+ *
+ * Local Signals are kept alive by the deliveries in flight, so a ShardedSignal
+ * may be destroyed while events are queued.
+ */
+template <typename data_type = VoidData>
+class ShardedSignal
+{
+public:
+
+	typedef ShardedSignal<data_type> self;
+
+	// Local Signal of one thread, with delivery from an external payload
+	class Local
+		: public Signal<data_type>
+	{
+	public:
+
+		void deliver( const data_type& payload ) const
+		{
+			SIGLOT_PROBE( emit_begin, this, this->count() );
+			this->slots.dispatch( [this,&payload]( ListenerCore *slot ) {
+				SIGLOT_PROBE( slot_begin, this, slot );
+				this->_call( slot, payload );
+				SIGLOT_PROBE( slot_end, this, slot );
+			});
+			SIGLOT_PROBE( emit_end, this );
+		}
+	};
+
+	data_type data;
+
+	ShardedSignal() {}
+	ShardedSignal( const self& ) = delete;
+	self& operator= ( const self& ) = delete;
+
+	// Local Signal for the subscribers on a given Dispatcher
+	Local* local( Dispatcher *d )
+	{
+		if ( !d ) return nullptr;
+
+		std::lock_guard<std::mutex> lock(mutex);
+		for ( auto& g: groups )
+			if ( g.dispatcher == d ) return g.signal.get();
+
+		groups.push_back( Group{ d, std::make_shared<Local>() } );
+		return groups.back().signal.get();
+	}
+
+	// Local Signal for the subscribers on the calling thread's Dispatcher
+	// (nullptr if the thread is not running a Dispatcher)
+	inline Local* local() { return local( Dispatcher::current() ); }
+
+	inline unsigned threads() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		return groups.size();
+	}
+
+	// Emit from any thread
+	inline void invoke() const { invoke(data); }
+
+	void invoke( const data_type& value ) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		if ( groups.empty() ) return;
+
+		std::shared_ptr<const data_type> payload;
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_copy );
+			payload = std::make_shared<const data_type>(value);
+		}
+		for ( auto& g: groups )
+			g.dispatcher->post( &self::_deliver, g.signal, payload );
+	}
+
+protected:
+
+	struct Group
+	{
+		Dispatcher *dispatcher;
+		std::shared_ptr<Local> signal;
+	};
+
+	mutable std::mutex mutex;
+	std::vector<Group> groups;
+
+	static void _deliver( void *signal, const void *payload )
+	{
+		static_cast<const Local*>(signal)->deliver( *static_cast<const data_type*>(payload) );
+	}
+};
+
+
+
+/**
+ * Pool of worker threads, each running a Dispatcher (a shard).
+ *
+ * - shards()  : number of workers
+ * - shard( i ): Dispatcher of a worker
+ * - wait()    : block until the tasks posted so far are done
+ *
+ * NOTE:
+ * wait() must not be called from a worker, which would wait for itself
+ * (this is asserted).
+ */
+class Executor
+{
+public:
+
+	explicit Executor( unsigned n = std::thread::hardware_concurrency() )
+	{
+		if ( n == 0 ) n = 1;
+		for ( unsigned i = 0; i < n; ++i ) dispatchers.emplace_back( new Dispatcher() );
+		for ( auto& d: dispatchers )
+		{
+			Dispatcher *p = d.get();
+			workers.emplace_back( [p]{ p->run(); } );
+		}
+	}
+
+	// Finish the queued tasks, and stop the workers
+	~Executor()
+	{
+		for ( auto& d: dispatchers ) d->stop();
+		for ( auto& w: workers ) w.join();
+	}
+
+	Executor( const Executor& ) = delete;
+	Executor& operator= ( const Executor& ) = delete;
+
+	inline unsigned shards() const { return dispatchers.size(); }
+	inline Dispatcher& shard( unsigned i ) { return *dispatchers[i]; }
+
+	// Is the calling thread one of the workers?
+	bool in_worker() const
+	{
+		const Dispatcher *d = Dispatcher::current();
+		for ( auto& w: dispatchers )
+			if ( w.get() == d ) return d != nullptr;
+		return false;
+	}
+
+	void wait()
+	{
+		assert( !in_worker() && "Executor::wait() called from one of its workers" );
+		auto b = std::make_shared<Barrier>( shards() );
+		for ( auto& d: dispatchers ) d->post( &Barrier::arrive, b, nullptr );
+
+		std::unique_lock<std::mutex> lock(b->mutex);
+		b->done.wait( lock, [&b]{ return b->remaining == 0; } );
+	}
+
+protected:
+
+	struct Barrier
+	{
+		std::mutex mutex;
+		std::condition_variable done;
+		unsigned remaining;
+
+		Barrier( unsigned n ): remaining(n) {}
+
+		static void arrive( void *target, const void* )
+		{
+			Barrier *b = static_cast<Barrier*>(target);
+			std::lock_guard<std::mutex> lock(b->mutex);
+			if ( --b->remaining == 0 ) b->done.notify_all();
+		}
+	};
+
+	std::vector< std::unique_ptr<Dispatcher> > dispatchers;
+	std::vector<std::thread> workers;
+};
+
+
+
+/**
+ * Queued Signal with key-partitioned parallel dispatch.
+ *
+ * Each emission is hashed by its key (given by a key extractor) onto one
+ * shard of an Executor, where the Slots are called. Events with the same key
+ * always go to the same shard, and are processed in emission order (for
+ * each emitting thread); events with different keys run in parallel.
+ *
+ * Slots subscribe as usual, and are therefore called from several worker
+ * threads concurrently (with different keys). Subscriptions must not change
+ * while events are in flight; call wait() on the Executor first. The
+ * destructor waits for the events of this Signal still in flight, so it must
+ * not run on a worker of the Executor while there are any (this is asserted).
+ *
+ * NOTE:
+ * This is a set of Slots, not a Signal: it cannot be used where a Signal is
+ * expected, whose synchronous invoke() would bypass the partitioning and run
+ * Slots concurrently with the workers.
+ */
+template <typename data_type, typename key_type = size_t>
+class PartitionedSignal
+	: public SlotSet<data_type>
+{
+public:
+
+	typedef PartitionedSignal<data_type,key_type> self;
+	typedef std::function<key_type( const data_type& )> extractor_type;
+
+	data_type data;
+
+	PartitionedSignal( Executor& e, extractor_type k )
+		: executor(e), key(k), in_flight(0) { SIGLOT_PROBE( signal_create, this ); }
+
+	~PartitionedSignal()
+	{
+		assert( !( in_flight.load() && executor.in_worker() ) &&
+			"PartitionedSignal destroyed by a worker with events in flight" );
+		while ( in_flight.load() ) std::this_thread::yield();
+		clear();
+		SIGLOT_PROBE( signal_destroy, this );
+	}
+
+	PartitionedSignal( const self& ) = delete;
+	self& operator= ( const self& ) = delete;
+
+	// Disconnect all slots (while no event is in flight)
+	inline void clear() { this->_clear(); }
+
+	// Shard processing the events of a given key
+	inline unsigned shard( const key_type& k ) const
+	{
+		return std::hash<key_type>()(k) % executor.shards();
+	}
+
+	// Queue the current data, or a given value (from any thread)
+	inline void invoke() { invoke( this->data ); }
+
+	void invoke( const data_type& value )
+	{
+		std::shared_ptr<const data_type> payload;
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_copy );
+			payload = std::make_shared<const data_type>(value);
+		}
+
+		in_flight.fetch_add(1);
+		SIGLOT_PROBE( queue, this, in_flight.load(), 0 );
+		executor.shard( shard(key(value)) ).post(
+			&self::_deliver,
+			std::shared_ptr<void>( std::shared_ptr<void>(), this ),
+			std::move(payload) );
+	}
+
+protected:
+
+	Executor& executor;
+	extractor_type key;
+	std::atomic<unsigned> in_flight;
+
+	// Read-only iteration, safe from several workers at once
+	static void _deliver( void *target, const void *payload )
+	{
+		self *s = static_cast<self*>(target);
+		const data_type& value = *static_cast<const data_type*>(payload);
+
+		SIGLOT_PROBE( emit_begin, s, s->count() );
+		s->slots.each( [s,&value]( ListenerCore *slot ) {
+			SIGLOT_PROBE( slot_begin, s, slot );
+			self::_call( slot, value );
+			SIGLOT_PROBE( slot_end, s, slot );
+		});
+		SIGLOT_PROBE( emit_end, s );
+
+		SIGLOT_PROBE( queue, s, s->in_flight.load() - 1, 0 );
+		s->in_flight.fetch_sub(1);
+	}
+};
+
+
+
+/**
+ * Merge of events from several threads into one total order.
+ *
+ * Producers post tasks (as with a Dispatcher) or invoke SequencedSignals from
+ * any thread; each thread appends to its own lane, so producers do not
+ * contend with each other. The thread running the Sequencer (run() or poll())
+ * collects the lanes, stamps each event with the next sequence number, and
+ * runs the events in that order. The order preserves the order of each
+ * producer, and is the same for every Slot; sequence() gives the number of
+ * the event being processed, eg to log or replicate the merged stream.
+ *
+ * Sequencers are not copyable; they must outlive the tasks posted to them.
+ */
+class Sequencer
+{
+public:
+
+	typedef Dispatcher::function_type function_type;
+
+	Sequencer(): queued(0), waiting(false), stopped(false), number(0), in_progress(false) {}
+
+	Sequencer( const Sequencer& ) = delete;
+	Sequencer& operator= ( const Sequencer& ) = delete;
+
+	// Sequencer of the calling thread, while it runs or polls one (or nullptr)
+	inline static Sequencer* current() { return _current(); }
+
+	// Sequence number of the event being processed (numbers start at 1),
+	// or of the last event processed
+	inline uint64_t sequence() const { return number; }
+
+	// Queue a task on the lane of the calling thread (from any thread)
+	void post( function_type f, std::shared_ptr<void> target, std::shared_ptr<const void> payload )
+	{
+		// The task is counted under the lane lock, so _collect cannot take it
+		// (and uncount it) before it is counted
+		Lane& l = _lane();
+		bool first;
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_queue );
+			std::lock_guard<std::mutex> lock(l.mutex);
+			l.queue.push_back( Task{ f, std::move(target), std::move(payload) } );
+			first = queued.fetch_add(1) == 0;
+		}
+
+		// Only wake the sequencing thread if it sleeps (or is about to), and
+		// has nothing left to do: otherwise it checks the lanes again anyway
+		if ( first && waiting.load() )
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			ready.notify_one();
+		}
+	}
+
+	// Number of tasks waiting, over all lanes
+	inline size_t pending() const { return queued.load(); }
+
+	// Sequence and run the tasks currently queued, and return their number
+	unsigned poll()
+	{
+		_collect();
+		return _run_batch();
+	}
+
+	// Sequence and run tasks as they come, until stop() is called and the
+	// lanes are empty
+	void run()
+	{
+		for ( ;; )
+		{
+			if ( !queued.load() )
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				waiting.store(true);
+				ready.wait( lock, [this]{ return stopped || queued.load(); } );
+				waiting.store(false);
+				if ( !queued.load() ) { stopped = false; return; }
+			}
+			poll();
+		}
+	}
+
+	// Make run() return once the lanes are empty (from any thread)
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopped = true;
+		}
+		ready.notify_all();
+	}
+
+protected:
+
+	struct Task
+	{
+		function_type function;
+		std::shared_ptr<void> target;
+		std::shared_ptr<const void> payload;
+	};
+
+	// Queue of one producer thread
+	struct Lane
+	{
+		std::mutex mutex;
+		std::vector<Task> queue;
+	};
+
+
+	PerThread<Lane> lanes;
+
+	std::atomic<size_t> queued;
+	std::atomic<bool> waiting;
+
+	std::mutex mutex;
+	std::condition_variable ready;
+	bool stopped;
+
+	std::vector<Task> swap, batch;
+	uint64_t number;
+	bool in_progress;
+
+	inline static Sequencer*& _current()
+	{
+		static thread_local Sequencer *s = nullptr;
+		return s;
+	}
+
+	// Lane of the calling thread, created on first use
+	inline Lane& _lane() { return lanes.local(); }
+
+	// Append the contents of each lane to the batch, in lane order
+	void _collect()
+	{
+		// Tasks posted while running a batch wait for the next one
+		if ( in_progress ) return;
+
+		lanes.each( [this]( Lane& l )
+		{
+			{
+				std::lock_guard<std::mutex> lane_lock(l.mutex);
+				swap.swap(l.queue);
+			}
+			if ( swap.empty() ) return;
+
+			queued.fetch_sub( swap.size() );
+			for ( auto& t: swap ) batch.push_back( std::move(t) );
+			swap.clear();
+		});
+	}
+
+	unsigned _run_batch()
+	{
+		if ( in_progress ) return 0;
+
+		Sequencer *previous = _current();
+		_current() = this;
+		in_progress = true;
+
+		const unsigned n = batch.size();
+		for ( auto& t: batch )
+		{
+			++number;
+			t.function( t.target.get(), t.payload.get() );
+		}
+		batch.clear();
+
+		in_progress = false;
+		_current() = previous;
+		return n;
+	}
+};
+
+
+
+/**
+ * Signal whose emissions are merged into the total order of a Sequencer.
+ *
+ * invoke() may be called from any thread: the value is queued on the lane of
+ * the calling thread, and the Slots are called by the sequencing thread, in
+ * the merged order (see Sequencer::sequence()). Several SequencedSignals of
+ * different types may share a Sequencer, for a single order across inputs.
+ *
+ * Subscriptions are changed from the sequencing thread, or while it is idle.
+ * The destructor waits for the events of this Signal still in flight, so it
+ * must not run on the sequencing thread while there are any (this is
+ * asserted).
+ *
+ * NOTE:
+ * This is a set of Slots, not a Signal: it cannot be used where a Signal is
+ * expected, whose synchronous invoke() would bypass the total order.
+ */
+template <typename data_type>
+class SequencedSignal
+	: public SlotSet<data_type>
+{
+public:
+
+	typedef SequencedSignal<data_type> self;
+
+	data_type data;
+
+	explicit SequencedSignal( Sequencer& s ): sequencer(s), in_flight(0) { SIGLOT_PROBE( signal_create, this ); }
+
+	~SequencedSignal()
+	{
+		assert( !( in_flight.load() && Sequencer::current() == &sequencer ) &&
+			"SequencedSignal destroyed by its Sequencer with events in flight" );
+		while ( in_flight.load() ) std::this_thread::yield();
+		clear();
+		SIGLOT_PROBE( signal_destroy, this );
+	}
+
+	SequencedSignal( const self& ) = delete;
+	self& operator= ( const self& ) = delete;
+
+	// Disconnect all slots (from the sequencing thread, or while it is idle)
+	inline void clear() { this->_clear(); }
+
+	// Queue the current data, or a given value (from any thread)
+	inline void invoke() { invoke( this->data ); }
+
+	void invoke( const data_type& value )
+	{
+		std::shared_ptr<const data_type> payload;
+		{
+			SIGLOT_ALLOC_SCOPE( alloc_copy );
+			payload = std::make_shared<const data_type>(value);
+		}
+
+		in_flight.fetch_add(1);
+		SIGLOT_PROBE( queue, this, in_flight.load(), 0 );
+		sequencer.post(
+			&self::_deliver,
+			std::shared_ptr<void>( std::shared_ptr<void>(), this ),
+			std::move(payload) );
+	}
+
+protected:
+
+	Sequencer& sequencer;
+	std::atomic<unsigned> in_flight;
+
+	static void _deliver( void *target, const void *payload )
+	{
+		self *s = static_cast<self*>(target);
+		const data_type& value = *static_cast<const data_type*>(payload);
+
+		SIGLOT_PROBE( emit_begin, s, s->count() );
+		s->slots.dispatch( [s,&value]( ListenerCore *slot ) {
+			SIGLOT_PROBE( slot_begin, s, slot );
+			self::_call( slot, value );
+			SIGLOT_PROBE( slot_end, s, slot );
+		});
+		SIGLOT_PROBE( emit_end, s );
+
+		SIGLOT_PROBE( queue, s, s->in_flight.load() - 1, 0 );
+		s->in_flight.fetch_sub(1);
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,102 @@
+#include "siglot_shm.h"
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+
+using namespace std;
+using namespace siglot;
+
+//=============================================
+// Live view of the statistics published by a ShmStatsProbe.
+//
+// Usage: siglot_top [segment=/siglot] [interval_ms=1000] [iterations=0 (forever)]
+//=============================================
+
+
+
+struct Row
+{
+    string name;
+    uint64_t emits, rate, deliveries, drops, depth, slowest_ns, slowest_slot;
+};
+
+int main( int argc, char *argv[] )
+{
+    string   segment    = argc > 1 ? argv[1] : "/siglot";
+    unsigned interval   = argc > 2 ? atoi(argv[2]) : 1000;
+    unsigned iterations = argc > 3 ? atoi(argv[3]) : 0;
+
+    ShmView view;
+    if ( !view.open(segment) )
+    {
+        cerr << "Could not open statistics segment " << segment << endl;
+        return 1;
+    }
+
+    // Start from a first reading, so that the first rates only cover one interval
+    vector<uint64_t> previous( view.capacity() );
+    for ( unsigned i = 0; i < view.capacity(); ++i )
+        previous[i] = view.record(i).emits.load(memory_order_relaxed);
+    uint64_t last = clock_now();
+
+    for ( unsigned it = 0; iterations == 0 || it < iterations; ++it )
+    {
+        this_thread::sleep_for( chrono::milliseconds(interval) );
+
+        /**
+         * Read every record in use, and compute the emit rate from the 
+         * difference with the previous reading, over the measured time.
+         */
+        const uint64_t now = clock_now();
+        const uint64_t elapsed = now > last ? now - last : 1;
+        last = now;
+
+        vector<Row> rows;
+        for ( unsigned i = 0; i < view.capacity(); ++i )
+        {
+            const ShmRecord& r = view.record(i);
+            uint64_t key = r.key.load(memory_order_acquire);
+            if ( !key ) continue;
+
+            Row row;
+            row.emits        = r.emits.load(memory_order_relaxed);
+            row.rate         = uint64_t( (row.emits - previous[i]) * 1e9 / elapsed );
+            row.deliveries   = r.deliveries.load(memory_order_relaxed);
+            row.drops        = r.drops.load(memory_order_relaxed);
+            row.depth        = r.queue_depth.load(memory_order_relaxed);
+            row.slowest_ns   = r.slowest_ns.load(memory_order_relaxed);
+            row.slowest_slot = r.slowest_slot.load(memory_order_relaxed);
+            previous[i]      = row.emits;
+
+            row.name = view.name(i);
+            if ( row.name.empty() )
+            {
+                ostringstream os; os << hex << "0x" << key;
+                row.name = os.str();
+            }
+            rows.push_back(row);
+        }
+
+        sort( rows.begin(), rows.end(), []( const Row& a, const Row& b ){ return a.rate > b.rate; } );
+
+        /**
+         * Print the table, most active Signals first.
+         */
+        cout << "\033[H\033[2J" << segment << "  signals: " << rows.size()
+             << "  overflow: " << view.head()->overflow.load(memory_order_relaxed) << "\n\n";
+        cout << left << setw(32) << "SIGNAL" << right 
+             << setw(12) << "EMITS/S" << setw(14) << "EMITS" << setw(14) << "DELIVERIES"
+             << setw(10) << "DROPS" << setw(8) << "QUEUE" << setw(14) << "SLOWEST(us)" 
+             << "  SLOWEST SLOT\n";
+
+        for ( auto& r: rows )
+            cout << left << setw(32) << r.name.substr(0,31) << right
+                 << setw(12) << r.rate << setw(14) << r.emits << setw(14) << r.deliveries
+                 << setw(10) << r.drops << setw(8) << r.depth << setw(14) << r.slowest_ns / 1000
+                 << "  0x" << hex << r.slowest_slot << dec << "\n";
+        cout << flush;
+    }
+}
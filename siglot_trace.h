@@ -0,0 +1,181 @@
+#ifndef __SIGLOT_TRACE__
+#define __SIGLOT_TRACE__
+
+#include "siglot.h"
+#include "siglot_clock.h"
+#include "siglot_perthread.h"
+
+#include <map>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <ostream>
+
+//=============================================
+// @filename     siglot_trace.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Traced event: the beginning or end of an emission (slot == nullptr),
+ * or of a slot callback within an emission.
+ */
+struct TraceEvent
+{
+	uint64_t time; // ns, see clock_now
+	const void *signal;
+	const void *slot;
+	bool begin;
+};
+
+
+
+/**
+ * Probe recording emissions and slot callbacks into per-thread ring buffers
+ * (see siglot.h, SIGLOT_INSTRUMENT), and exporting them as Chrome trace JSON
+ * (chrome://tracing, ui.perfetto.dev).
+ *
+ * Each buffer keeps the "capacity" most recent events of its thread. Nesting
+ * follows from the order of begin/end events, so cascades of Signals invoked
+ * from within callbacks show as stacked spans on the timeline.
+ *
+ * NOTE:
+ * Recording takes no lock. Export while no Signal is being invoked to get a
+ * consistent trace.
+ */
+class TraceProbe
+	: public Probe
+{
+public:
+
+	TraceProbe( unsigned capacity = 1u << 16 )
+		: capacity(capacity ? capacity : 1) {}
+
+	TraceProbe( const TraceProbe& other ) = delete;
+	TraceProbe& operator= ( const TraceProbe& other ) = delete;
+
+	// Label a Signal or a Slot in the exported trace
+	void name( const void *p, const std::string& label )
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		names[p] = label;
+	}
+
+	void emit_begin( const void *signal, unsigned ) { _record( signal, nullptr, true ); }
+	void emit_end( const void *signal ) { _record( signal, nullptr, false ); }
+	void slot_begin( const void *signal, const void *slot ) { _record( signal, slot, true ); }
+	void slot_end( const void *signal, const void *slot ) { _record( signal, slot, false ); }
+
+	// Events still in the buffer of each thread, in chronological order
+	std::vector< std::vector<TraceEvent> > events() const
+	{
+		std::vector< std::vector<TraceEvent> > out;
+		rings.each( [&out]( Ring& r ){ out.push_back( r.ordered() ); } );
+		return out;
+	}
+
+	// Write the trace in Chrome JSON format
+	void export_json( std::ostream& os ) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		os << "{\"traceEvents\":[";
+
+		unsigned t = 0;
+		rings.each( [&]( Ring& r )
+		{
+			os << (t ? "," : "") << "\n{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":"
+			   << t+1 << ",\"args\":{\"name\":\"siglot thread " << t+1 << "\"}}";
+
+			// Skip the ends of spans whose beginning was overwritten
+			unsigned depth = 0;
+			for ( auto& e: r.ordered() )
+			{
+				if ( e.begin ) ++depth;
+				else if ( depth ) --depth;
+				else continue;
+
+				os << ",\n{\"ph\":\"" << (e.begin ? 'B' : 'E') << "\",\"pid\":1,\"tid\":" << t+1
+				   << ",\"ts\":" << e.time / 1000 << '.' << _pad3( e.time % 1000 )
+				   << ",\"cat\":\"" << (e.slot ? "slot" : "emit") << "\",\"name\":\"";
+				_label( os, e.slot ? e.slot : e.signal, e.slot ? "slot" : "signal" );
+				os << "\",\"args\":{\"signal\":\"";
+				_label( os, e.signal, "signal" );
+				os << "\"}}";
+			}
+			++t;
+		});
+		os << "\n]}\n";
+	}
+
+protected:
+
+	// Single-writer ring buffer
+	struct Ring
+	{
+		std::vector<TraceEvent> buf;
+		std::atomic<uint64_t> written;
+
+		Ring( unsigned n ): buf(n), written(0) {}
+
+		inline void push( const TraceEvent& e )
+		{
+			uint64_t w = written.load(std::memory_order_relaxed);
+			buf[ w % buf.size() ] = e;
+			written.store( w+1, std::memory_order_release );
+		}
+
+		std::vector<TraceEvent> ordered() const
+		{
+			uint64_t w = written.load(std::memory_order_acquire), n = buf.size();
+			std::vector<TraceEvent> out;
+			for ( uint64_t i = w > n ? w-n : 0; i < w; ++i ) out.push_back( buf[i % n] );
+			return out;
+		}
+	};
+
+	inline void _record( const void *signal, const void *slot, bool begin )
+	{
+		TraceEvent e;
+		e.time = clock_now(); e.signal = signal; e.slot = slot; e.begin = begin;
+		_ring().push(e);
+	}
+
+	// Ring of the calling thread, created on first use
+	inline Ring& _ring() { return rings.local( capacity ); }
+
+	void _label( std::ostream& os, const void *p, const char *kind ) const
+	{
+		auto it = names.find(p);
+		if ( it == names.end() ) { os << kind << ' ' << p; return; }
+
+		for ( char c: it->second )
+			if ( c == '"' || c == '\\' ) os << '\\' << c;
+			else if ( static_cast<unsigned char>(c) >= 0x20 ) os << c;
+	}
+
+	inline static std::string _pad3( unsigned v )
+	{
+		char s[4] = { char('0' + v/100), char('0' + v/10%10), char('0' + v%10), 0 };
+		return s;
+	}
+
+	unsigned capacity;
+	PerThread<Ring> rings;
+
+	mutable std::mutex mutex; // of the names
+	std::map<const void*, std::string> names;
+};
+
+}
+
+#endif
@@ -0,0 +1,206 @@
+#ifndef __SIGLOT_TREE__
+#define __SIGLOT_TREE__
+
+#include "siglot.h"
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+//=============================================
+// @filename     siglot_tree.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Hierarchical propagation, as in the DOM.
+ *
+ * EventNodes form a user-defined tree (eg widgets or scene-graph nodes), and
+ * each node has a "capture" and a "bubble" Signal. Emitting an event on a
+ * target node runs three phases:
+ * - capture: the capture Signals of the ancestors, from the root down;
+ * - target : the capture, then the bubble Signal of the target;
+ * - bubble : the bubble Signals of the ancestors, up to the root.
+ *
+ * Slots receive a TreeEvent, and may call stop() to prevent propagation to
+ * the next node; the other Slots of the current Signal are still called, and
+ * so are both Signals of the target (as in the DOM).
+ *
+ * The path from the root to each node is computed on the first emission and
+ * cached; it is invalidated (for the whole subtree) only when the node or one
+ * of its ancestors changes parent. The path of an emission is fixed when it
+ * starts: Slots may move nodes, or destroy nodes other than the one whose
+ * Signal calls them, in which case the emission skips the destroyed nodes.
+ */
+enum class Phase { capture, target, bubble };
+
+template <typename data_type> class EventNode;
+
+template <typename data_type = VoidData>
+struct TreeEvent
+{
+	typedef EventNode<data_type> node_type;
+
+	const data_type *payload;
+	node_type *target;
+	node_type *current;
+	Phase phase;
+	mutable bool stopped;
+
+	TreeEvent(): payload(nullptr), target(nullptr), current(nullptr),
+		phase(Phase::target), stopped(false) {}
+
+	inline const data_type& data() const { return *payload; }
+
+	// Do not propagate to the next node
+	inline void stop() const { stopped = true; }
+};
+
+
+
+/**
+ * Node of the propagation tree.
+ */
+template <typename data_type = VoidData>
+class EventNode
+{
+public:
+
+	typedef EventNode<data_type> self;
+	typedef TreeEvent<data_type> event_type;
+	typedef std::vector<self*> path_type;
+
+	Signal<event_type> capture;
+	Signal<event_type> bubble;
+
+	EventNode( self *parent = nullptr ): up(nullptr), life( std::make_shared<char>(0) ) { attach(parent); }
+
+	// Children are detached, and become roots
+	~EventNode()
+	{
+		life.reset();
+		detach();
+		for ( auto c: down ) { c->up = nullptr; c->_invalidate(); }
+	}
+
+	// Nodes are bound to their position in the tree
+	EventNode( const self& ) = delete;
+	self& operator= ( const self& ) = delete;
+
+	inline self* parent() const { return up; }
+	inline const path_type& children() const { return down; }
+
+	// Move the node (and its subtree) under a new parent
+	void attach( self *parent )
+	{
+		if ( parent == up ) return;
+		detach();
+		if ( (up = parent) ) up->down.push_back(this);
+		_invalidate();
+	}
+
+	// Make the node a root
+	void detach()
+	{
+		if ( !up ) return;
+		up->down.erase( std::find( up->down.begin(), up->down.end(), this ) );
+		up = nullptr;
+		_invalidate();
+	}
+
+	// Nodes from the root to this one (included)
+	const path_type& path() const { return _path()->nodes; }
+
+	// Run the capture, target and bubble phases with this node as target;
+	// returns false if propagation was stopped.
+	bool emit( const data_type& data = data_type() )
+	{
+		// Only the path is used from here, as Slots may destroy any node,
+		// including this one
+		std::shared_ptr<const Path> p = _path();
+		const unsigned target = p->nodes.size() - 1;
+
+		event_type e;
+		e.payload = &data;
+		e.target  = this;
+
+		e.phase = Phase::capture;
+		for ( unsigned i = 0; i < target; ++i )
+			if ( !_dispatch( *p, i, true, e ) ) return false;
+
+		e.phase = Phase::target;
+		const bool captured = _dispatch( *p, target, true, e );
+		if ( !_dispatch( *p, target, false, e ) || !captured ) return false;
+
+		e.phase = Phase::bubble;
+		for ( unsigned i = target; i-- > 0; )
+			if ( !_dispatch( *p, i, false, e ) ) return false;
+
+		return true;
+	}
+
+protected:
+
+	// Nodes from the root, and whether they still exist
+	struct Path
+	{
+		path_type nodes;
+		std::vector< std::weak_ptr<char> > alive;
+	};
+
+	self *up;
+	path_type down;
+	std::shared_ptr<char> life; // expires when the node is destroyed
+	mutable std::shared_ptr<const Path> cached;
+
+	// Clear the cached paths of the subtree
+	void _invalidate()
+	{
+		if ( !cached ) return;
+		cached.reset();
+		for ( auto c: down ) c->_invalidate();
+	}
+
+	std::shared_ptr<const Path> _path() const
+	{
+		if ( !cached )
+		{
+			Path *p = up ? new Path( *up->_path() ) : new Path();
+			p->nodes.push_back( const_cast<self*>(this) );
+			p->alive.push_back( life );
+			cached.reset(p);
+		}
+		return cached;
+	}
+
+	// Invoke a Signal of the i-th node of a path with the event (preserving
+	// the current data of the Signal, in case of nested emissions), and
+	// report whether to continue. Destroyed nodes are skipped.
+	static bool _dispatch( const Path& p, unsigned i, bool capturing, event_type& e )
+	{
+		if ( p.alive[i].expired() ) return true;
+
+		self *node = p.nodes[i];
+		Signal<event_type>& signal = capturing ? node->capture : node->bubble;
+		if ( signal.count() == 0 ) return true;
+
+		event_type saved = signal.data;
+		e.current   = node;
+		signal.data = e;
+		signal.invoke();
+		e.stopped   = signal.data.stopped;
+		signal.data = saved;
+
+		return !e.stopped;
+	}
+};
+
+}
+
+#endif
@@ -0,0 +1,307 @@
+#ifndef __SIGLOT_WATCHDOG__
+#define __SIGLOT_WATCHDOG__
+
+#include "siglot.h"
+#include "siglot_clock.h"
+#include "siglot_perthread.h"
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+//=============================================
+// @filename     siglot_watchdog.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Reported by the watchdog when a callback in progress exceeds its budget
+ * ("stuck" once it exceeds the stuck threshold as well).
+ */
+struct WatchdogReport
+{
+	const void *signal;
+	const void *slot;
+	unsigned thread;   // index of the thread, in order of first callback
+	uint64_t elapsed;  // ns since the callback started
+	uint64_t budget;   // ns
+	bool stuck;
+};
+
+/**
+ * Probe enforcing latency budgets on Slot callbacks (see siglot.h,
+ * SIGLOT_INSTRUMENT). A Slot subscribes to one Signal at a time, so its
+ * budget applies to its current subscription.
+ *
+ * On the hot path, each callback only publishes its start time in a table
+ * owned by the calling thread, under a sequence lock: the monitor retries
+ * when the record changes while it reads it, so a report never mixes two
+ * callbacks. Completed callbacks over budget are counted
+ * exactly on exit; a monitor thread (start/stop) scans callbacks in progress,
+ * and reports each one once when it goes over budget, and once more if it
+ * is still running after "stuck_factor" times its budget.
+ *
+ * NOTE:
+ * Budgets should be set before the probe is installed, or while no Signal
+ * is being invoked.
+ */
+class WatchdogProbe
+	: public Probe
+{
+public:
+
+	typedef std::function<void( const WatchdogReport& )> handler_type;
+	typedef std::chrono::nanoseconds duration;
+
+	WatchdogProbe( handler_type h = handler_type(), unsigned stuck_factor = 10 )
+		: handler(h), stuck_factor(stuck_factor ? stuck_factor : 1),
+		  default_budget(0), total_overruns(0), running(false) {}
+
+	~WatchdogProbe() { stop(); }
+
+	WatchdogProbe( const WatchdogProbe& other ) = delete;
+	WatchdogProbe& operator= ( const WatchdogProbe& other ) = delete;
+
+	// Budget of a given Slot, or of all Slots without a specific budget (0 to disable)
+	void budget( const void *slot, duration d ) { budgets[slot].limit = d.count(); }
+	void budget( duration d ) { default_budget = d.count(); }
+
+	// Number of completed callbacks over budget, and the slowest one, for a given Slot
+	uint64_t overruns( const void *slot ) const
+	{
+		auto it = budgets.find(slot);
+		return it == budgets.end() ? 0 : it->second.overruns.load(std::memory_order_relaxed);
+	}
+	uint64_t worst( const void *slot ) const
+	{
+		auto it = budgets.find(slot);
+		return it == budgets.end() ? 0 : it->second.worst.load(std::memory_order_relaxed);
+	}
+
+	// Total number of completed callbacks over budget (including default budgets)
+	inline uint64_t overruns() const { return total_overruns.load(std::memory_order_relaxed); }
+
+	// Run the monitor thread, which checks callbacks in progress periodically
+	void start( duration period = std::chrono::milliseconds(10) )
+	{
+		stop();
+		running = true;
+		monitor = std::thread( [this, period]()
+		{
+			std::unique_lock<std::mutex> lock(monitor_mutex);
+			while ( !wakeup.wait_for( lock, period, [this]{ return !running; } ) )
+				check();
+		});
+	}
+
+	void stop()
+	{
+		{
+			std::lock_guard<std::mutex> lock(monitor_mutex);
+			running = false;
+		}
+		wakeup.notify_all();
+		if ( monitor.joinable() ) monitor.join();
+	}
+
+	// Scan callbacks in progress once (called periodically by the monitor).
+	// The handler is called after the scan, without holding any lock, so it
+	// may invoke Signals watched by this probe.
+	void check()
+	{
+		std::vector<WatchdogReport> reports;
+		const uint64_t now = clock_now();
+		unsigned t = 0;
+
+		threads.each( [&]( ThreadState& s )
+		{
+			unsigned depth = s.depth.load(std::memory_order_acquire);
+			if ( depth > max_depth ) depth = max_depth;
+
+			for ( unsigned k = 0; k < depth; ++k )
+			{
+				Record c;
+				if ( !s.entries[k].read(c) || k >= s.depth.load(std::memory_order_acquire) ) continue;
+				const uint64_t start = c.start, limit = c.limit;
+				if ( !limit || now <= start + limit ) continue;
+
+				// Report each stage of a given callback only once
+				bool stuck = now > start + stuck_factor * limit;
+				Reported& r = s.reported[k];
+				if ( r.start == start && r.stuck >= stuck ) continue;
+				r.start = start; r.stuck = stuck;
+
+				if ( handler )
+				{
+					WatchdogReport report;
+					report.signal  = c.signal;
+					report.slot    = c.slot;
+					report.thread  = t;
+					report.elapsed = now - start;
+					report.budget  = limit;
+					report.stuck   = stuck;
+					reports.push_back( report );
+				}
+			}
+			++t;
+		});
+
+		for ( auto& report: reports ) handler( report );
+	}
+
+	void slot_begin( const void *signal, const void *slot )
+	{
+		ThreadState& s = _state();
+		unsigned k = s.depth.load(std::memory_order_relaxed);
+		if ( k < max_depth )
+		{
+			Entry& e = s.entries[k];
+			Budget *b = _budget( slot );
+			e.write( signal, slot, clock_now(), b ? b->limit : default_budget );
+		}
+		s.depth.store( k+1, std::memory_order_release );
+	}
+
+	void slot_end( const void*, const void *slot )
+	{
+		ThreadState& s = _state();
+		unsigned k = s.depth.load(std::memory_order_relaxed) - 1;
+		s.depth.store( k, std::memory_order_release );
+		if ( k >= max_depth ) return;
+
+		Entry& e = s.entries[k];
+		e.retire();
+		uint64_t limit = e.limit.load(std::memory_order_relaxed);
+		uint64_t d = clock_now() - e.start.load(std::memory_order_relaxed);
+		if ( !limit || d <= limit ) return;
+
+		total_overruns.fetch_add( 1, std::memory_order_relaxed );
+		if ( Budget *b = _budget( slot ) )
+		{
+			b->overruns.fetch_add( 1, std::memory_order_relaxed );
+			if ( d > b->worst.load(std::memory_order_relaxed) )
+				b->worst.store( d, std::memory_order_relaxed );
+		}
+	}
+
+protected:
+
+	static const unsigned max_depth = 32;
+
+	struct Budget
+	{
+		uint64_t limit;
+		std::atomic<uint64_t> overruns, worst;
+		Budget(): limit(0), overruns(0), worst(0) {}
+	};
+
+	// Copy of an entry, read by the monitor
+	struct Record
+	{
+		const void *signal, *slot;
+		uint64_t start, limit;
+	};
+
+	// Callback in progress, published by its thread under a sequence lock
+	// (the version is odd while the entry is written, and changes again
+	// when the callback ends)
+	struct Entry
+	{
+		std::atomic<uint64_t> version;
+		std::atomic<const void*> signal, slot;
+		std::atomic<uint64_t> start, limit;
+		Entry(): version(0), signal(nullptr), slot(nullptr), start(0), limit(0) {}
+
+		// Only called by the owner thread
+		void write( const void *sig, const void *sl, uint64_t t, uint64_t l )
+		{
+			const uint64_t v = version.load(std::memory_order_relaxed);
+			version.store( v + 1, std::memory_order_relaxed );
+			std::atomic_thread_fence(std::memory_order_release);
+			signal.store( sig, std::memory_order_relaxed );
+			slot.store( sl, std::memory_order_relaxed );
+			start.store( t, std::memory_order_relaxed );
+			limit.store( l, std::memory_order_relaxed );
+			version.store( v + 2, std::memory_order_release );
+		}
+		inline void retire()
+		{
+			version.store( version.load(std::memory_order_relaxed) + 2, std::memory_order_release );
+		}
+
+		// Consistent copy; false if the entry keeps changing
+		bool read( Record& r ) const
+		{
+			for ( unsigned attempt = 0; attempt < 64; ++attempt )
+			{
+				const uint64_t v = version.load(std::memory_order_acquire);
+				if ( v & 1 ) continue;
+				r.signal = signal.load(std::memory_order_relaxed);
+				r.slot   = slot.load(std::memory_order_relaxed);
+				r.start  = start.load(std::memory_order_relaxed);
+				r.limit  = limit.load(std::memory_order_relaxed);
+				std::atomic_thread_fence(std::memory_order_acquire);
+				if ( version.load(std::memory_order_relaxed) == v ) return true;
+			}
+			return false;
+		}
+	};
+
+	// Last report of the monitor for an entry
+	struct Reported
+	{
+		uint64_t start;
+		bool stuck;
+		Reported(): start(~uint64_t(0)), stuck(false) {}
+	};
+
+	struct ThreadState
+	{
+		std::atomic<unsigned> depth;
+		Entry entries[max_depth];
+		Reported reported[max_depth];
+
+		ThreadState(): depth(0) {}
+	};
+
+	inline Budget* _budget( const void *slot )
+	{
+		if ( budgets.empty() ) return nullptr;
+		auto it = budgets.find(slot);
+		return it == budgets.end() ? nullptr : &it->second;
+	}
+
+	// State of the calling thread, created on first use
+	inline ThreadState& _state() { return threads.local(); }
+
+	handler_type handler;
+	unsigned stuck_factor;
+	uint64_t default_budget;
+
+	std::unordered_map<const void*, Budget> budgets;
+	std::atomic<uint64_t> total_overruns;
+
+	PerThread<ThreadState> threads;
+
+	bool running;
+	std::thread monitor;
+	std::mutex monitor_mutex;
+	std::condition_variable wakeup;
+};
+
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef __SIGLOT_WIRING__
+#define __SIGLOT_WIRING__
+
+#include "siglot.h"
+
+#include <atomic>
+#include <vector>
+#include <cassert>
+#include <cstdint>
+#include <algorithm>
+#include <unordered_map>
+
+//=============================================
+// @filename     siglot_wiring.h
+// @author       Sheljohn (Jonathan H)
+// @contact      Jonathan.hadida@dtc.ox.ac.uk
+// @license      Creative Commons by-sa 3.0
+//               http://creativecommons.org/licenses/by-sa/3.0/
+//=============================================
+
+namespace siglot
+{
+
+/**
+ * Declarative bulk wiring.
+ *
+ * A Wiring is a table of connections (Signal, Slot), described in code or
+ * generated, which is applied in one pass: connections are bucketed by
+ * Signal (counting sort), and each Signal receives its subscribers as one
+ * sorted contiguous array (the flat form of SlotStorage), without any
+ * per-connection tree insertion.
+ *
+ * - signal( s )           : register a Signal, and get its handle in the table
+ * - connect( handle, slot ): add a connection to a registered Signal
+ * - connect( s, slot )     : same, registering the Signal if needed
+ * - apply()                : make all connections, and clear the table
+ *
+ * Handles carry the data type of their Signal, so that Slots can only be
+ * connected to Signals of the same type, as with subscribe. Only the Wiring
+ * makes handles, and each handle is only valid for the table that made it:
+ * apply() and clear() start a new table, and connect asserts that the
+ * handle is still valid (see valid).
+ *
+ * The result is the same as calling slot.subscribe(s) for each connection in
+ * order: a Slot connected several times ends up on the last Signal, and
+ * Signals keep their existing subscribers. Probes see one unsubscribe for
+ * each Slot that leaves its previous Signal, and one subscribe for each Slot
+ * that joins a new one. Signals start in flat form, which the adaptive
+ * storage may change later if their access pattern requires it.
+ */
+class Wiring
+{
+public:
+
+	// Index of a registered Signal of a given data type, in a given table
+	template <typename data_type>
+	class Handle
+	{
+	public:
+		Handle(): index(0), table(0) {}
+
+	private:
+		friend class Wiring;
+		Handle( unsigned i, uint64_t t ): index(i), table(t) {}
+
+		unsigned index;
+		uint64_t table;
+	};
+
+	Wiring(): table(_next_table()), last_signal(nullptr), last_index(0) {}
+
+	// Expected number of connections and Signals
+	void reserve( size_t connections, size_t signals = 0 )
+	{
+		edges.reserve(connections);
+		targets.reserve(signals);
+	}
+
+	// Register a Signal
+	template <typename data_type>
+	Handle<data_type> signal( SlotSet<data_type> *s )
+	{
+		auto it = index.find(s);
+		if ( it != index.end() ) return Handle<data_type>( it->second, table );
+
+		index[s] = targets.size();
+		targets.push_back(s);
+		return Handle<data_type>( targets.size() - 1, table );
+	}
+
+	// Was the handle made by the current table of this Wiring?
+	template <typename data_type>
+	inline bool valid( Handle<data_type> h ) const
+	{
+		return h.table == table && h.index < targets.size();
+	}
+
+	// Add a connection to a registered Signal
+	template <typename data_type>
+	inline void connect( Handle<data_type> h, ListenerInterface<data_type>& slot )
+	{
+		assert( valid(h) && "Wiring::connect with a handle of another table" );
+		edges.push_back( Edge( h.index, &slot ) );
+	}
+
+	template <typename data_type>
+	inline void connect( SlotSet<data_type> *s, ListenerInterface<data_type>& slot )
+	{
+		if ( s != last_signal ) { last_index = signal(s).index; last_signal = s; }
+		edges.push_back( Edge( last_index, &slot ) );
+	}
+
+	inline size_t connections() const { return edges.size(); }
+	inline size_t signals() const { return targets.size(); }
+
+	// Make all connections in one pass
+	void apply()
+	{
+		// Point each Slot to its final Signal; Slots are marked inactive until
+		// they are placed, and their previous subscriptions are kept aside
+		std::vector< std::pair<ListenerCore*, SlotSetCore*> > previous;
+		for ( auto& e: edges )
+		{
+			assert( e.signal < targets.size() );
+			ListenerCore *slot = e.slot;
+			if ( slot->_is_active() ) previous.push_back( std::make_pair( slot, slot->signal ) );
+			slot->active = false;
+			slot->signal = targets[e.signal];
+		}
+
+		// Leave the previous Signal, or stay there (already placed)
+		for ( auto& p: previous )
+		{
+			ListenerCore *slot = p.first;
+			if ( p.second == slot->signal ) { slot->active = true; continue; }
+
+			SIGLOT_PROBE( unsubscribe, p.second, slot );
+			p.second->_unsubscribe(slot);
+		}
+
+		// Count the connections of each Signal (an upper bound), and allocate the arrays
+		std::vector<unsigned> counts( targets.size(), 0 );
+		for ( auto& e: edges )
+			if ( !e.slot->active && e.slot->signal == targets[e.signal] ) ++counts[e.signal];
+
+		std::vector< std::vector<ListenerCore*> > arrays( targets.size() );
+		for ( unsigned i = 0; i < targets.size(); ++i )
+		{
+			if ( counts[i] == 0 ) continue;
+			arrays[i].reserve( counts[i] + targets[i]->count() );
+			targets[i]->slots.each( [&]( ListenerCore *slot ) { arrays[i].push_back(slot); } );
+		}
+
+		// Distribute the Slots (once each), then sort each array
+		for ( auto& e: edges )
+		{
+			ListenerCore *slot = e.slot;
+			if ( slot->active || slot->signal != targets[e.signal] ) continue;
+
+			arrays[e.signal].push_back(slot);
+			slot->active = true;
+			SIGLOT_PROBE( subscribe, slot->signal, slot );
+		}
+
+		for ( unsigned i = 0; i < targets.size(); ++i )
+		{
+			if ( counts[i] == 0 ) continue;
+
+			std::vector<ListenerCore*>& a = arrays[i];
+			std::sort( a.begin(), a.end() );
+			a.erase( std::unique( a.begin(), a.end() ), a.end() );
+
+			SlotSetCore *s = targets[i];
+			if ( s->count() == a.size() ) continue;
+
+			s->slots.assign(a);
+			++s->changes;
+		}
+
+		clear();
+	}
+
+	void clear()
+	{
+		edges.clear();
+		targets.clear();
+		index.clear();
+		last_signal = nullptr;
+		table = _next_table();
+	}
+
+private:
+
+	// Tables are numbered across all Wirings, so that handles of a previous
+	// table, or of another Wiring, are never valid
+	static uint64_t _next_table() { static std::atomic<uint64_t> n(1); return n++; }
+
+	struct Edge
+	{
+		unsigned signal;
+		ListenerCore *slot;
+		Edge( unsigned s, ListenerCore *l ): signal(s), slot(l) {}
+	};
+
+	std::vector<Edge> edges;
+	std::vector<SlotSetCore*> targets;
+	std::unordered_map<const SlotSetCore*, unsigned> index;
+	uint64_t table;
+
+	const SlotSetCore *last_signal;
+	unsigned last_index;
+};
+
+}
+
+#endif